@@ -24,15 +24,12 @@ char PredecessorChar(const Coordinates coord, const Coordinates pred)
     return ' ';
 }
 
-void PrintBfs(const BfsResult & bfsResult)
+void PrintBfs(const Map & map, const BfsEngine & bfs)
 {
-    for (Row y = 0; y < MapSize; y++) {
-        for (Column x = 0; x < MapSize; x++) {
+    for (Row y = 0; y < map.GetHeight(); y++) {
+        for (Column x = 0; x < map.GetWidth(); x++) {
             Coordinates coord = {x, y};
-            optional<Coordinates> pred;
-            if (Contains(bfsResult.predecessors, coord)) {
-                pred = bfsResult.predecessors.at(coord);
-            }
+            optional<Coordinates> pred = bfs.GetPredecessor(coord);
             if (pred) {
                 std::cout << PredecessorChar(coord, *pred);
             } else {
@@ -48,8 +45,9 @@ int main(int /*argc*/, char ** /*argv*/)
     // State state = surroundedState;
     const auto [map, state] = puzzleInput;
 
-    BfsResult bfsResult = Bfs(map, state, {29, 2});
-    PrintBfs(bfsResult);
+    BfsEngine bfs;
+    bfs.Run(map, state, {29, 2});
+    PrintBfs(map, bfs);
 
     return 0;
 }
\ No newline at end of file
@@ -1,11 +1,15 @@
 // Copyright (C) 2018 David Holmes <dholmes@dholmes.us>. All rights reserved.
 
+#include "termios.hpp"
+
+#include <unistd.h> // For STDOUT_FILENO
+
 #include <algorithm>
 #include <array>
-#include <bitset>
-#include <cassert>
 #include <charconv>
+#include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <iomanip>
 #include <iostream>
 #include <limits>
@@ -13,17 +17,11 @@
 #include <set>
 #include <string>
 #include <string_view>
-#include <thread>
+#include <system_error>
 #include <tuple>
+#include <utility>
 #include <vector>
 
-using namespace std::chrono_literals;
-
-const auto maxDisplayDimension = 64;
-
-using SceneRow = std::bitset<maxDisplayDimension>;
-using Scene = std::array<SceneRow, maxDisplayDimension>;
-
 struct Position
 {
     std::int32_t x;
@@ -104,30 +102,123 @@ std::vector<Point> ReadPoints(std::istream & stream)
     return out;
 }
 
+// The points stored as structure-of-arrays, so that moving all of them is a
+// handful of simple loops the compiler can vectorize.
+struct PointCloud
+{
+    std::vector<std::int32_t> x;
+    std::vector<std::int32_t> y;
+    std::vector<std::int32_t> dx;
+    std::vector<std::int32_t> dy;
+
+    std::size_t Size() const { return x.size(); }
+};
+
+PointCloud ToPointCloud(const std::vector<Point> & points)
+{
+    PointCloud cloud;
+    cloud.x.reserve(points.size());
+    cloud.y.reserve(points.size());
+    cloud.dx.reserve(points.size());
+    cloud.dy.reserve(points.size());
+    for (auto & [pos, vel] : points) {
+        cloud.x.push_back(pos.x);
+        cloud.y.push_back(pos.y);
+        cloud.dx.push_back(vel.dx);
+        cloud.dy.push_back(vel.dy);
+    }
+    return cloud;
+}
+
+// Moves every point "seconds" steps along its velocity.
+void Advance(PointCloud & cloud, std::int32_t seconds)
+{
+    const auto size = cloud.Size();
+    for (std::size_t i = 0; i < size; i++) {
+        cloud.x[i] += cloud.dx[i] * seconds;
+    }
+    for (std::size_t i = 0; i < size; i++) {
+        cloud.y[i] += cloud.dy[i] * seconds;
+    }
+}
+
 struct Area
 {
     Position nwCorner;
     Position seCorner;
 };
 
-Area GetBoundaries(const std::vector<Point> & points)
+// Returns the smallest range containing the given coordinates after they have
+// moved "seconds" steps.
+std::pair<std::int32_t, std::int32_t>
+GetRange(const std::vector<std::int32_t> & positions,
+         const std::vector<std::int32_t> & velocities, std::int32_t seconds)
 {
-    if (points.empty()) {
+    auto min = std::numeric_limits<std::int32_t>::max();
+    auto max = std::numeric_limits<std::int32_t>::min();
+    for (std::size_t i = 0; i < positions.size(); i++) {
+        const std::int32_t pos = positions[i] + velocities[i] * seconds;
+        min = std::min(min, pos);
+        max = std::max(max, pos);
+    }
+    return {min, max};
+}
+
+Area GetBoundaries(const PointCloud & cloud, std::int32_t seconds = 0)
+{
+    if (cloud.Size() == 0) {
         return {{0, 0}, {0, 0}};
     }
-    Area area;
-    auto max = std::numeric_limits<decltype(area.nwCorner.x)>::max();
-    auto min = std::numeric_limits<decltype(area.nwCorner.x)>::min();
-    area.nwCorner = {max, max};
-    area.seCorner = {min, min};
-    for (auto & p : points) {
-        Position pos = p.pos;
-        area.nwCorner.x = std::min(area.nwCorner.x, pos.x);
-        area.nwCorner.y = std::min(area.nwCorner.y, pos.y);
-        area.seCorner.x = std::max(area.seCorner.x, pos.x);
-        area.seCorner.y = std::max(area.seCorner.y, pos.y);
+    auto [minX, maxX] = GetRange(cloud.x, cloud.dx, seconds);
+    auto [minY, maxY] = GetRange(cloud.y, cloud.dy, seconds);
+    return {{minX, minY}, {maxX, maxY}};
+}
+
+std::int64_t GetAreaSize(const PointCloud & cloud, std::int32_t seconds)
+{
+    const Area area = GetBoundaries(cloud, seconds);
+    return std::int64_t{area.seCorner.x - area.nwCorner.x + 1} *
+           (area.seCorner.y - area.nwCorner.y + 1);
+}
+
+// Finds the time at which the points' bounding box is smallest, which is when
+// they spell out the message.
+//
+// The box's width and height are each the difference between a maximum and a
+// minimum of linear functions, so both shrink until some point and grow after
+// it.  This doubles an upper bound until the area starts growing and then
+// ternary searches the bracketed range.
+std::int32_t FindConvergenceTime(const PointCloud & cloud)
+{
+    const auto area = [&](std::int32_t seconds) {
+        return GetAreaSize(cloud, seconds);
+    };
+
+    std::int32_t high = 1;
+    while (area(high + 1) < area(high)) {
+        high *= 2;
+    }
+    std::int32_t low = high / 2;
+    high++;
+
+    while (high - low > 2) {
+        const std::int32_t third = (high - low) / 3;
+        const std::int32_t m1 = low + third;
+        const std::int32_t m2 = high - third;
+        if (area(m1) < area(m2)) {
+            high = m2;
+        } else {
+            low = m1;
+        }
     }
-    return area;
+
+    std::int32_t best = low;
+    for (std::int32_t seconds = low + 1; seconds <= high; seconds++) {
+        if (area(seconds) < area(best)) {
+            best = seconds;
+        }
+    }
+    return best;
 }
 
 const std::array<const char *, 16> quadrantStrings = {
@@ -141,74 +232,236 @@ QuadrantsToStr(bool upperLeft, bool upperRight, bool lowerLeft, bool lowerRight)
                            lowerRight << 3];
 }
 
-void PrintScene(std::ostream & stream, Scene & scene)
+struct TerminalSize
 {
+    std::int32_t columns;
+    std::int32_t rows;
+};
 
-    for (int y = 0; y < maxDisplayDimension - 1; y += 2) {
-        for (int x = 0; x < maxDisplayDimension - 1; x += 2) {
-            stream << QuadrantsToStr(scene[y][x], scene[y][x + 1],
-                                     scene[y + 1][x], scene[y + 1][x + 1]);
+// Returns the size of the terminal on stdout, or a standard 80x24 if stdout
+// isn't a terminal.
+TerminalSize GetTerminalSize()
+{
+    try {
+        const winsize size = posix::get_window_size(STDOUT_FILENO);
+        if (size.ws_col > 0 && size.ws_row > 0) {
+            return {size.ws_col, size.ws_row};
         }
-        stream << '\n';
+    } catch (const std::system_error &) {
     }
+    return {80, 24};
 }
 
-/// Draws the scene, at (1/(scaleFactor+1)) scale.
-void DrawSceneScale(std::ostream & stream, const std::vector<Point> & points,
-                    std::int32_t scaleExponent)
+Area ScaleArea(const Area & area, std::int32_t scaleExponent)
 {
-    const Area area = GetBoundaries(points);
-    Area scaledArea;
-    scaledArea.nwCorner = {area.nwCorner.x >> scaleExponent,
-                           area.nwCorner.y >> scaleExponent};
-    scaledArea.seCorner = {area.seCorner.x >> scaleExponent,
-                           area.seCorner.y >> scaleExponent};
+    return {
+        {area.nwCorner.x >> scaleExponent, area.nwCorner.y >> scaleExponent},
+        {area.seCorner.x >> scaleExponent, area.seCorner.y >> scaleExponent}};
+}
 
-    using SceneRow = std::bitset<maxDisplayDimension>;
-    using Scene = std::array<SceneRow, maxDisplayDimension>;
-    Scene scene = {0};
+// Returns the smallest scale at which the scene fits in the given number of
+// terminal columns and rows.  Each character cell shows 2x2 pixels.
+std::int32_t ChooseScaleExponent(const Area & area, TerminalSize terminal)
+{
+    std::int32_t scaleExponent = 0;
+    while (scaleExponent < 31) {
+        const Area scaled = ScaleArea(area, scaleExponent);
+        const auto width = scaled.seCorner.x - scaled.nwCorner.x + 1;
+        const auto height = scaled.seCorner.y - scaled.nwCorner.y + 1;
+        if ((width + 1) / 2 <= terminal.columns &&
+            (height + 1) / 2 <= terminal.rows) {
+            break;
+        }
+        scaleExponent++;
+    }
+    return scaleExponent;
+}
 
-    for (auto & p : points) {
-        Position pos = p.pos;
-        Position scaledPos = {pos.x >> scaleExponent, pos.y >> scaleExponent};
+/// Renders the scene as quadrant characters, at (1/2^scaleExponent) scale.
+std::string RasterizeScene(const PointCloud & points,
+                           std::int32_t scaleExponent)
+{
+    if (points.Size() == 0) {
+        return {};
+    }
 
-        assert(scaledPos.x >= scaledArea.nwCorner.x);
-        assert(scaledPos.y >= scaledArea.nwCorner.y);
-        assert(scaledPos.x <= scaledArea.seCorner.x);
-        assert(scaledPos.y <= scaledArea.seCorner.y);
+    // One bit per scaled pixel, rounded up to whole character cells.
+    const Area scaledArea = ScaleArea(GetBoundaries(points), scaleExponent);
+    const auto columns =
+        (scaledArea.seCorner.x - scaledArea.nwCorner.x + 2) / 2;
+    const auto rows = (scaledArea.seCorner.y - scaledArea.nwCorner.y + 2) / 2;
+    const auto width = std::size_t(columns) * 2;
+    const auto height = std::size_t(rows) * 2;
+    std::vector<std::uint64_t> pixels((width * height + 63) / 64, 0);
+    for (std::size_t i = 0; i < points.Size(); i++) {
+        const std::size_t x =
+            (points.x[i] >> scaleExponent) - scaledArea.nwCorner.x;
+        const std::size_t y =
+            (points.y[i] >> scaleExponent) - scaledArea.nwCorner.y;
+        const auto bit = y * width + x;
+        pixels[bit / 64] |= std::uint64_t(1) << (bit % 64);
+    }
+    const auto pixel = [&](std::size_t x, std::size_t y) {
+        const auto bit = y * width + x;
+        return ((pixels[bit / 64] >> (bit % 64)) & 1) != 0;
+    };
+
+    // No quadrant glyph is more than three bytes long in UTF-8.
+    std::string out;
+    out.reserve((std::size_t(columns) * 3 + 1) * rows);
+    for (std::size_t y = 0; y < height; y += 2) {
+        for (std::size_t x = 0; x < width; x += 2) {
+            out += QuadrantsToStr(pixel(x, y), pixel(x + 1, y),
+                                  pixel(x, y + 1), pixel(x + 1, y + 1));
+        }
+        out += '\n';
+    }
+    return out;
+}
 
-        Position shiftedScaledPos = {scaledPos.x - scaledArea.nwCorner.x,
-                                     scaledPos.y - scaledArea.nwCorner.y};
+// Draws the scene at the largest scale that fits in the terminal.
+void DrawScene(std::ostream & stream, const PointCloud & points)
+{
+    const Area area = GetBoundaries(points);
+    // Leave a row for the line printed after the scene.
+    TerminalSize terminal = GetTerminalSize();
+    terminal.rows--;
+    stream << RasterizeScene(points, ChooseScaleExponent(area, terminal));
+}
 
-        assert(shiftedScaledPos.x >= 0);
-        assert(shiftedScaledPos.y >= 0);
-        assert(shiftedScaledPos.x < maxDisplayDimension);
-        assert(shiftedScaledPos.y < maxDisplayDimension);
+// The messages are written in a 6x10 font, with two blank columns between
+// letters.  Each letter is packed into a word with bit (row * 6 + column) set
+// for each lit pixel.
+const std::int32_t glyphWidth = 6;
+const std::int32_t glyphHeight = 10;
+const std::int32_t glyphPitch = glyphWidth + 2;
 
-        scene[shiftedScaledPos.y][shiftedScaledPos.x] = true;
-    }
+using GlyphBits = std::uint64_t;
 
-    PrintScene(stream, scene);
+constexpr GlyphBits PackGlyph(std::string_view pixels)
+{
+    GlyphBits bits = 0;
+    for (std::size_t i = 0; i < pixels.size(); i++) {
+        if (pixels[i] == '#') {
+            bits |= GlyphBits(1) << i;
+        }
+    }
+    return bits;
 }
 
-int main(int /*argc*/, char ** /*argv*/)
+struct Glyph
 {
-    const std::vector<Point> inputPoints = ReadPoints(std::cin);
-    std::vector<Point> points = inputPoints;
+    char letter;
+    GlyphBits bits;
+};
 
-    DrawSceneScale(std::cout, points, 11);
+// clang-format off
+const std::array<Glyph, 15> glyphs = {{
+    {'A', PackGlyph("..##.." ".#..#." "#....#" "#....#" "#....#"
+                    "######" "#....#" "#....#" "#....#" "#....#")},
+    {'B', PackGlyph("#####." "#....#" "#....#" "#....#" "#####."
+                    "#....#" "#....#" "#....#" "#....#" "#####.")},
+    {'C', PackGlyph(".####." "#....#" "#....." "#....." "#....."
+                    "#....." "#....." "#....." "#....#" ".####.")},
+    {'E', PackGlyph("######" "#....." "#....." "#....." "#####."
+                    "#....." "#....." "#....." "#....." "######")},
+    {'F', PackGlyph("######" "#....." "#....." "#....." "#####."
+                    "#....." "#....." "#....." "#....." "#.....")},
+    {'G', PackGlyph(".####." "#....#" "#....." "#....." "#....."
+                    "#..###" "#....#" "#....#" "#...##" ".###.#")},
+    {'H', PackGlyph("#....#" "#....#" "#....#" "#....#" "######"
+                    "#....#" "#....#" "#....#" "#....#" "#....#")},
+    {'J', PackGlyph("...###" "....#." "....#." "....#." "....#."
+                    "....#." "....#." "#...#." "#...#." ".###..")},
+    {'K', PackGlyph("#....#" "#...#." "#..#.." "#.#..." "##...."
+                    "##...." "#.#..." "#..#.." "#...#." "#....#")},
+    {'L', PackGlyph("#....." "#....." "#....." "#....." "#....."
+                    "#....." "#....." "#....." "#....." "######")},
+    {'N', PackGlyph("#....#" "##...#" "##...#" "#.#..#" "#.#..#"
+                    "#..#.#" "#..#.#" "#...##" "#...##" "#....#")},
+    {'P', PackGlyph("#####." "#....#" "#....#" "#....#" "#####."
+                    "#....." "#....." "#....." "#....." "#.....")},
+    {'R', PackGlyph("#####." "#....#" "#....#" "#....#" "#####."
+                    "#..#.." "#...#." "#...#." "#....#" "#....#")},
+    {'X', PackGlyph("#....#" "#....#" ".#..#." ".#..#." "..##.."
+                    "..##.." ".#..#." ".#..#." "#....#" "#....#")},
+    {'Z', PackGlyph("######" ".....#" ".....#" "....#." "...#.."
+                    "..#..." ".#...." "#....." "#....." "######")},
+}};
+// clang-format on
+
+// Reads the message spelled out by the points, which must already be at their
+// convergence time.  Letters that aren't in the font are returned as '?'.
+std::string RecognizeMessage(const PointCloud & points)
+{
+    const Area area = GetBoundaries(points);
+    const auto width = area.seCorner.x - area.nwCorner.x + 1;
+    const auto height = area.seCorner.y - area.nwCorner.y + 1;
+    if (points.Size() == 0 || height != glyphHeight) {
+        return {};
+    }
 
-    for (int i = 1; i < 11000; i++) {
-        for (auto & [pos, vel] : points) {
-            pos.x += vel.dx * 1;
-            pos.y += vel.dy * 1;
+    // Slice the cropped scene into letter cells, setting each point's bit in
+    // its cell.  A point in the gap between cells can't be part of any letter.
+    const auto letterCount = (width + glyphPitch - 1) / glyphPitch;
+    std::vector<GlyphBits> cells(letterCount, 0);
+    std::vector<bool> malformed(letterCount, false);
+    for (std::size_t i = 0; i < points.Size(); i++) {
+        const auto x = points.x[i] - area.nwCorner.x;
+        const auto y = points.y[i] - area.nwCorner.y;
+        const auto cell = x / glyphPitch;
+        const auto column = x % glyphPitch;
+        if (column >= glyphWidth) {
+            malformed[cell] = true;
+        } else {
+            cells[cell] |= GlyphBits(1) << (y * glyphWidth + column);
         }
-        if (i > 10354 && i < 10356) {
-            std::this_thread::sleep_for(500ms);
-            std::cout << i << '\n';
-            DrawSceneScale(std::cout, points, 0);
+    }
+
+    std::string message;
+    for (std::size_t cell = 0; cell < cells.size(); cell++) {
+        auto glyph = std::find_if(
+            glyphs.begin(), glyphs.end(),
+            [&](const Glyph & g) { return g.bits == cells[cell]; });
+        const bool known = !malformed[cell] && glyph != glyphs.end();
+        message.push_back(known ? glyph->letter : '?');
+    }
+    return message;
+}
+
+int main(int argc, char ** argv)
+{
+    // With --headless, only the message and time are printed, so this can run
+    // without a terminal.
+    bool headless = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::string_view(argv[i]) == "--headless") {
+            headless = true;
+        } else {
+            std::cerr << "USAGE: " << argv[0] << " [--headless] < input.txt\n";
+            std::exit(1);
         }
     }
 
+    PointCloud points = ToPointCloud(ReadPoints(std::cin));
+
+    if (!headless) {
+        DrawScene(std::cout, points);
+    }
+
+    const auto seconds = FindConvergenceTime(points);
+    Advance(points, seconds);
+    std::cout << seconds << '\n';
+    if (!headless) {
+        DrawScene(std::cout, points);
+    }
+
+    const std::string message = RecognizeMessage(points);
+    if (message.empty()) {
+        std::cout << "No message recognized.\n";
+    } else {
+        std::cout << "Message: " << message << '\n';
+    }
+
     return 0;
 }
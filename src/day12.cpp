@@ -1,62 +1,139 @@
 // Copyright (C) 2018 David Holmes <dholmes@dholmes.us>. All rights reserved.
 
+#include <array>
+#include <bitset>
+#include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <iomanip>
 #include <iostream>
 #include <regex>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 using PlantIndex = std::int64_t;
 using Generation = std::uint64_t;
 using FivePlants = std::uint8_t;
 
-const std::int32_t maxPlants = 1024;
-const PlantIndex plantZeroIndex = maxPlants / 2;
+// Plants are stored 64 to a word, with bit N of word W holding the plant at
+// index (W * 64 + N).  Word numbers may be negative.
+using PlantWord = std::uint64_t;
+const std::int32_t plantWordBits = 64;
 
-using PlantBitset = std::bitset<maxPlants>;
+PlantIndex WordOf(PlantIndex pos)
+{
+    // Round towards negative infinity so negative indices land in the right
+    // word.
+    return pos >= 0 ? pos / plantWordBits
+                    : -((-pos + plantWordBits - 1) / plantWordBits);
+}
+
+std::int32_t BitOf(PlantIndex pos)
+{
+    return static_cast<std::int32_t>(pos - WordOf(pos) * plantWordBits);
+}
 
 const auto lastGeneration = 200;
 
+// An unbounded row of pots.  Only the words between the first and last living
+// plants are stored; the tape grows in either direction as plants spread.
 class PlantCollection
 {
 public:
-    static const PlantIndex min = plantZeroIndex - maxPlants;
-    static const PlantIndex max = maxPlants - plantZeroIndex;
+    PlantCollection() = default;
+    PlantCollection(PlantIndex firstWord, std::vector<PlantWord> words)
+        : firstWord(firstWord), words(std::move(words))
+    {
+        Trim();
+    }
 
-    bool Get(PlantIndex pos) const { return plants[pos + plantZeroIndex]; }
-    void Set(PlantIndex pos, bool val) { plants[pos + plantZeroIndex] = val; }
-    FivePlants GetFivePlants(PlantIndex middle) const
+    bool Get(PlantIndex pos) const
     {
-        FivePlants out = 0;
-        for (PlantIndex i = middle - 2; i <= middle + 2; i++) {
-            out <<= 1;
-            out |= Get(i);
+        return (GetWord(WordOf(pos)) >> BitOf(pos)) & 1;
+    }
+    // Returns the word with the given word number, which is empty if it's
+    // outside the stored range.
+    PlantWord GetWord(PlantIndex word) const
+    {
+        const auto i = word - firstWord;
+        if (i < 0 || i >= static_cast<PlantIndex>(words.size())) {
+            return 0;
         }
-        return out;
+        return words[i];
     }
 
-    PlantIndex FindFirst() const
+    bool Empty() const { return words.empty(); }
+
+    // The first and last living plants.  Only meaningful if not Empty().
+    PlantIndex GetFirst() const { return first; }
+    PlantIndex GetLast() const { return last; }
+
+    // The word numbers of the first and last stored words.
+    PlantIndex GetFirstWord() const { return firstWord; }
+    PlantIndex GetLastWord() const { return firstWord + words.size() - 1; }
+
+    // Returns the plants shifted so the first one is bit 0 of word 0, so two
+    // collections holding the same pattern at different positions compare
+    // equal.
+    std::vector<PlantWord> GetPattern() const
     {
-        for (PlantIndex i = min; i < max; i++) {
-            if (Get(i)) {
-                return i;
+        if (words.empty()) {
+            return {};
+        }
+        const auto shift = BitOf(first);
+        std::vector<PlantWord> pattern(WordOf(last - first) + 1);
+        for (std::size_t i = 0; i < pattern.size(); i++) {
+            pattern[i] = words[i] >> shift;
+            if (shift != 0 && i + 1 < words.size()) {
+                pattern[i] |= words[i + 1] << (plantWordBits - shift);
             }
         }
-        return max;
+        return pattern;
     }
 
-    std::pair<PlantBitset, PlantIndex> GetBits() const
+private:
+    // Drops empty words from both ends and finds the live range.
+    void Trim()
     {
-        auto firstPlant = FindFirst();
-        auto firstBit = firstPlant + plantZeroIndex;
-        auto shifted = plants >> firstBit;
-        return {shifted, firstPlant};
+        std::size_t begin = 0;
+        while (begin < words.size() && words[begin] == 0) {
+            begin++;
+        }
+        std::size_t end = words.size();
+        while (end > begin && words[end - 1] == 0) {
+            end--;
+        }
+        words.erase(words.begin() + end, words.end());
+        words.erase(words.begin(), words.begin() + begin);
+        firstWord += begin;
+
+        if (words.empty()) {
+            firstWord = 0;
+            first = 0;
+            last = -1;
+            return;
+        }
+
+        std::int32_t bit = 0;
+        while (((words.front() >> bit) & 1) == 0) {
+            bit++;
+        }
+        first = firstWord * plantWordBits + bit;
+
+        bit = plantWordBits - 1;
+        while (((words.back() >> bit) & 1) == 0) {
+            bit--;
+        }
+        last = (firstWord + words.size() - 1) * plantWordBits + bit;
     }
 
-private:
-    PlantBitset plants;
+    PlantIndex firstWord = 0;
+    std::vector<PlantWord> words;
+    PlantIndex first = 0;
+    PlantIndex last = -1;
 };
 
 void WritePlantCollectionRange(std::ostream & stream,
@@ -79,21 +156,71 @@ PlantCollection ParseInitialState(std::string_view str)
     auto len = match[1].second - match[1].first;
     std::string_view stateStr(match[1].first, len);
 
-    PlantCollection initialState;
+    // Build the words first and trim once, as the range is only known at
+    // the end.
+    std::vector<PlantWord> words(WordOf(len + plantWordBits - 1));
     for (int i = 0; i < len; i++) {
-        initialState.Set(i, stateStr[i] == '#');
+        if (stateStr[i] == '#') {
+            words[WordOf(i)] |= PlantWord(1) << BitOf(i);
+        }
+    }
+    return {0, std::move(words)};
+}
+
+// Evaluates the notes for 64 pots at once.  "neighbors" holds, for each of the
+// five pots in a note from left to right, a word whose bit N is that pot's
+// plant for the Nth of the 64 pots.  "noteWords" is the NoteSet with each
+// output expanded to all zeros or all ones.
+//
+// This treats the notes as a truth table and multiplexes it down one input at
+// a time, starting with the rightmost pot (the least significant bit of the
+// note), so the result for all 64 pots takes 31 word-wide selects.
+PlantWord ApplyNotes(const std::array<PlantWord, 32> & noteWords,
+                     const std::array<PlantWord, 5> & neighbors)
+{
+    std::array<PlantWord, 32> results = noteWords;
+    std::size_t count = results.size();
+    for (auto pot = neighbors.rbegin(); pot != neighbors.rend(); ++pot) {
+        count /= 2;
+        for (std::size_t i = 0; i < count; i++) {
+            results[i] = (*pot & results[2 * i + 1]) | (~*pot & results[2 * i]);
+        }
     }
-    return initialState;
+    return results[0];
 }
 
+// Only the live region and two pots on either side of it can hold plants in
+// the next generation, so only those words are computed.  This assumes empty
+// pots stay empty, which main() checks.
 PlantCollection NewGeneration(const PlantCollection & parent, NoteSet notes)
 {
-    PlantCollection out;
-    for (auto i = PlantCollection::min + 2; i <= PlantCollection::max - 2;
-         i++) {
-        out.Set(i, notes[parent.GetFivePlants(i)]);
+    if (parent.Empty()) {
+        return {};
+    }
+
+    std::array<PlantWord, 32> noteWords;
+    for (std::size_t i = 0; i < noteWords.size(); i++) {
+        noteWords[i] = notes[i] ? ~PlantWord(0) : 0;
     }
-    return out;
+
+    const auto firstWord = WordOf(parent.GetFirst() - 2);
+    const auto lastWord = WordOf(parent.GetLast() + 2);
+    std::vector<PlantWord> words(lastWord - firstWord + 1);
+    for (auto w = firstWord; w <= lastWord; w++) {
+        const PlantWord prev = parent.GetWord(w - 1);
+        const PlantWord curr = parent.GetWord(w);
+        const PlantWord next = parent.GetWord(w + 1);
+        const std::array<PlantWord, 5> neighbors = {
+            (curr << 2) | (prev >> (plantWordBits - 2)),
+            (curr << 1) | (prev >> (plantWordBits - 1)),
+            curr,
+            (curr >> 1) | (next << (plantWordBits - 1)),
+            (curr >> 2) | (next << (plantWordBits - 2)),
+        };
+        words[w - firstWord] = ApplyNotes(noteWords, neighbors);
+    }
+
+    return {firstWord, std::move(words)};
 }
 
 void PrintSpaces(std::ostream & stream, std::uint8_t count)
@@ -175,72 +302,99 @@ void PrintNoteSet(std::ostream & stream, const NoteSet & noteSet)
     }
 }
 
-std::int64_t PlantNumberSum(const PlantCollection & plants)
+std::int64_t PopCount(PlantWord word)
+{
+    return static_cast<std::int64_t>(std::bitset<plantWordBits>(word).count());
+}
+
+// Returns the sum of the positions (0-63) of the set bits in a word.  Bit K of
+// each position is counted by masking the bits whose position has bit K set.
+std::int64_t BitPositionSum(PlantWord word)
 {
+    static const std::array<PlantWord, 6> positionBitMasks = {
+        0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+        0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL,
+    };
     std::int64_t sum = 0;
-    for (PlantIndex i = PlantCollection::min; i < PlantCollection::max; i++) {
-        if (plants.Get(i)) {
-            sum += i;
-        }
+    for (std::size_t k = 0; k < positionBitMasks.size(); k++) {
+        sum += PopCount(word & positionBitMasks[k]) << k;
     }
     return sum;
 }
 
-std::int64_t PlantNumberSum(const PlantBitset & bitset, PlantIndex first)
+// Returns the sum of plant numbers as if every plant were moved "shift" pots to
+// the right.
+std::int64_t PlantNumberSum(const PlantCollection & plants, PlantIndex shift)
 {
     std::int64_t sum = 0;
-    for (std::int64_t i = 0; i < static_cast<std::int64_t>(bitset.size());
-         i++) {
-        PlantIndex plantNumber = i + first;
-        if (bitset[i]) {
-            sum += plantNumber;
-        }
+    if (plants.Empty()) {
+        return sum;
+    }
+    for (auto w = plants.GetFirstWord(); w <= plants.GetLastWord(); w++) {
+        const PlantWord word = plants.GetWord(w);
+        const std::int64_t wordStart = w * plantWordBits + shift;
+        sum += PopCount(word) * wordStart + BitPositionSum(word);
     }
     return sum;
 }
 
-void PartTwo(std::array<PlantCollection, lastGeneration + 1> & plantGenerations)
+std::int64_t PlantNumberSum(const PlantCollection & plants)
 {
+    return PlantNumberSum(plants, 0);
+}
 
-    std::array<std::pair<PlantBitset, PlantIndex>, lastGeneration + 1>
-        plantGenerationBitsets;
-
-    for (Generation gen = 0; gen <= lastGeneration; gen++) {
-        plantGenerationBitsets[gen] = plantGenerations[gen].GetBits();
+struct PatternHash
+{
+    std::size_t operator()(const std::vector<PlantWord> & pattern) const
+    {
+        std::size_t hash = pattern.size();
+        for (PlantWord word : pattern) {
+            hash ^= std::hash<PlantWord>{}(word) + 0x9e3779b97f4a7c15ULL +
+                    (hash << 6) + (hash >> 2);
+        }
+        return hash;
     }
+};
 
-    // Find the first repeat.
-    auto repeatStartGen = -1;
-    // auto lastOriginalGen = -1;
-    auto repeatFactor = -1;
-    auto repeatShift = 0;
-    for (Generation gen = 1; gen <= lastGeneration; gen++) {
-        auto & [bits, first] = plantGenerationBitsets[gen];
-        for (Generation prevGen = 0; prevGen < gen; prevGen++) {
-            auto & [prevBits, prevFirst] = plantGenerationBitsets[prevGen];
-            if (bits == prevBits) {
-                std::cout << "Generation " << gen << " is a repeat of "
-                          << prevGen << ".\n";
-                repeatStartGen = prevGen;
-                repeatFactor = gen - prevGen;
-                repeatShift = first - prevFirst;
-
-                auto targetGen = 50000000000LL;
-                auto targetGenAdjusted = targetGen - repeatStartGen;
-                auto repeatCount = targetGenAdjusted / repeatFactor;
-                auto targetShift = repeatShift * repeatCount;
-
-                std::cout << "Sum of plant numbers at generation #" << targetGen
-                          << ": "
-                          << PlantNumberSum(bits, first + targetShift - 1)
-                          << '\n';
-
-                return;
+// Runs generations until a pattern repeats (possibly shifted), then uses the
+// cycle to find the plant number sum at a distant generation.
+void PartTwo(const PlantCollection & initialState, NoteSet notes)
+{
+    const Generation targetGen = 50000000000ULL;
+
+    // First generation each pattern was seen in, and where its first plant was.
+    std::unordered_map<std::vector<PlantWord>,
+                       std::pair<Generation, PlantIndex>, PatternHash>
+        seen;
+
+    PlantCollection plants = initialState;
+    for (Generation gen = 0; gen < targetGen; gen++) {
+        auto [it, inserted] = seen.try_emplace(plants.GetPattern(), gen,
+                                               plants.GetFirst());
+        if (!inserted) {
+            auto [prevGen, prevFirst] = it->second;
+            std::cout << "Generation " << gen << " is a repeat of " << prevGen
+                      << ".\n";
+
+            const Generation period = gen - prevGen;
+            const PlantIndex shiftPerPeriod = plants.GetFirst() - prevFirst;
+            const Generation remaining = targetGen - gen;
+            for (Generation i = 0; i < remaining % period; i++) {
+                plants = NewGeneration(plants, notes);
             }
+            const PlantIndex shift =
+                shiftPerPeriod * static_cast<PlantIndex>(remaining / period);
+
+            std::cout << "Sum of plant numbers at generation #" << targetGen
+                      << ": " << PlantNumberSum(plants, shift) << '\n';
+            return;
         }
+        plants = NewGeneration(plants, notes);
     }
 
     std::cout << "No repeats found!\n";
+    std::cout << "Sum of plant numbers at generation #" << targetGen << ": "
+              << PlantNumberSum(plants) << '\n';
 }
 
 int main(int /*argc*/, char ** /*argv*/)
@@ -266,6 +420,12 @@ int main(int /*argc*/, char ** /*argv*/)
     std::cout << "Notes:\n";
     PrintNoteSet(std::cout, noteSet);
 
+    if (noteSet[0]) {
+        std::cerr << "Notes grow plants in empty pots, which would fill the "
+                     "infinite row.\n";
+        std::exit(1);
+    }
+
     std::array<PlantCollection, lastGeneration + 1> plantGenerations;
     plantGenerations[0] = initialState;
     for (Generation gen = 1; gen <= lastGeneration; gen++) {
@@ -281,7 +441,7 @@ int main(int /*argc*/, char ** /*argv*/)
     std::cout << "Sum of plant numbers at generation #20: "
               << PlantNumberSum(plantGenerations[20]) << '\n';
 
-    PartTwo(plantGenerations);
+    PartTwo(initialState, noteSet);
 
     return 0;
 }
@@ -0,0 +1,958 @@
+// Copyright (C) 2018 David Holmes <dholmes@dholmes.us>. All rights reserved.
+
+#ifndef AOC_DAY13_HPP
+#define AOC_DAY13_HPP
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace day13 {
+
+using std::array;
+using std::int16_t;
+using std::optional;
+using std::pair;
+using std::string;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+using std::vector;
+
+enum Direction : std::uint8_t
+{
+    North = 1,
+    East = 2,
+    South = 4,
+    West = 8,
+};
+
+using Directions = uint8_t;
+using Coordinate = pair<int16_t, int16_t>;
+// The set of Directions a piece of track connects, packed into one byte.
+enum class TrackTile : uint8_t
+{
+};
+using CartId = uint32_t;
+using CartIndex = uint32_t;
+using MaybeCart = optional<pair<Coordinate, Direction>>;
+using ErrorString = std::string;
+
+// Input lines, all padded with spaces to the width of the longest line.
+using InputChars = vector<string>;
+
+std::string_view TrackTileToString(const TrackTile tile)
+{
+    if (tile == TrackTile()) {
+        return " ";
+    } else if (tile == TrackTile(North | South)) {
+        return "│";
+    } else if (tile == TrackTile(East | West)) {
+        return "─";
+    } else if (tile == TrackTile(North | West)) {
+        return "╯";
+    } else if (tile == TrackTile(South | East)) {
+        return "╭";
+    } else if (tile == TrackTile(North | East)) {
+        return "╰";
+    } else if (tile == TrackTile(South | West)) {
+        return "╮";
+    } else if (tile == TrackTile(North | South | East | West)) {
+        return "┼";
+    }
+    return " ";
+}
+
+// Stream insertion operator for Coordinate.
+std::ostream & operator<<(std::ostream & stream, const Coordinate & coord)
+{
+    stream << static_cast<int>(coord.first) << ','
+           << static_cast<int>(coord.second);
+    return stream;
+}
+
+// Stream insertion operator for TrackTile.
+std::ostream & operator<<(std::ostream & stream, const TrackTile & tile)
+{
+    stream << TrackTileToString(tile);
+    return stream;
+}
+
+// The track layout, stored row-major in a single contiguous buffer sized to
+// the input.
+class Track
+{
+public:
+    Track(int16_t width, int16_t height)
+        : width(width), height(height),
+          tiles(static_cast<std::size_t>(width) * height, TrackTile())
+    {}
+
+    int16_t GetWidth() const { return width; }
+    int16_t GetHeight() const { return height; }
+
+    TrackTile Get(const Coordinate & coord) const
+    {
+        return tiles[Index(coord)];
+    }
+    void Set(const Coordinate & coord, TrackTile tile)
+    {
+        tiles[Index(coord)] = tile;
+    }
+
+private:
+    std::size_t Index(const Coordinate & coord) const
+    {
+        auto [x, y] = coord;
+        return static_cast<std::size_t>(y) * width + x;
+    }
+
+    int16_t width;
+    int16_t height;
+    vector<TrackTile> tiles;
+};
+
+char DirectionToChar(Direction direction)
+{
+    switch (direction) {
+    case North:
+        return '^';
+    case South:
+        return 'v';
+    case East:
+        return '>';
+    case West:
+        return '<';
+    }
+
+    assert(false);
+    return ' ';
+}
+
+// Stream insertion operator for Direction.
+std::ostream & operator<<(std::ostream & stream, const Direction & direction)
+{
+    stream << DirectionToChar(direction);
+    return stream;
+}
+
+enum class TurnDecision : uint8_t
+{
+    Left = 0,
+    Straight = 1,
+    Right = 2,
+};
+
+// What a cart does on a tile: the direction it leaves in and the decision it
+// will make at the next intersection.
+struct TurnResult
+{
+    Direction direction;
+    TurnDecision nextDecision;
+};
+
+constexpr Direction TurnLeft(Direction direction)
+{
+    switch (direction) {
+    case North:
+        return West;
+    case West:
+        return South;
+    case South:
+        return East;
+    case East:
+        return North;
+    }
+    return direction;
+}
+
+constexpr Direction TurnRight(Direction direction)
+{
+    return TurnLeft(TurnLeft(TurnLeft(direction)));
+}
+
+constexpr Direction Reverse(Direction direction)
+{
+    return TurnLeft(TurnLeft(direction));
+}
+
+// Whether the tile connects exactly one of north/south to exactly one of
+// east/west.
+constexpr bool IsCurve(uint8_t tile)
+{
+    const uint8_t vertical = tile & (North | South);
+    const uint8_t horizontal = tile & (East | West);
+    return (vertical == North || vertical == South) &&
+           (horizontal == East || horizontal == West);
+}
+
+// TurnTable[tile][direction][decision] is the TurnResult for a cart moving in
+// "direction" which arrives on "tile" planning to make "decision" at the next
+// intersection.  Only the entries for the four Direction values are used.
+using TurnTable = array<array<array<TurnResult, 3>, West + 1>, 16>;
+
+constexpr TurnTable MakeTurnTable()
+{
+    TurnTable table = {};
+    const array<Direction, 4> directions = {North, East, South, West};
+    for (uint8_t tile = 0; tile < table.size(); tile++) {
+        for (Direction direction : directions) {
+            for (uint8_t d = 0; d < 3; d++) {
+                const auto decision = static_cast<TurnDecision>(d);
+                TurnResult result = {direction, decision};
+                if (tile == (North | South | East | West)) {
+                    if (decision == TurnDecision::Left) {
+                        result.direction = TurnLeft(direction);
+                    } else if (decision == TurnDecision::Right) {
+                        result.direction = TurnRight(direction);
+                    }
+                    result.nextDecision =
+                        static_cast<TurnDecision>((d + 1) % 3);
+                } else if (IsCurve(tile) && (tile & Reverse(direction))) {
+                    // Leave through whichever side we didn't come in through.
+                    result.direction =
+                        static_cast<Direction>(tile & ~Reverse(direction));
+                }
+                table[tile][direction][d] = result;
+            }
+        }
+    }
+    return table;
+}
+
+constexpr TurnTable turnTable = MakeTurnTable();
+
+constexpr TurnResult LookupTurn(TrackTile tile, Direction direction,
+                                TurnDecision decision)
+{
+    return turnTable[static_cast<uint8_t>(tile)][direction]
+                    [static_cast<uint8_t>(decision)];
+}
+
+class Cart
+{
+
+public:
+    Cart(CartId id, Coordinate coordinates, Direction direction)
+        : id(id), coordinates(coordinates), direction(direction),
+          nextDecision(TurnDecision::Left)
+    {}
+
+    CartId GetId() const { return id; }
+    Coordinate GetCoordinates() const { return coordinates; }
+    Direction GetDirection() const { return direction; }
+
+    void Move(int16_t distance = 1)
+    {
+        auto & [x, y] = coordinates;
+        if (direction == Direction::North) {
+            y -= distance;
+        } else if (direction == Direction::South) {
+            y += distance;
+        } else if (direction == Direction::West) {
+            x -= distance;
+        } else if (direction == Direction::East) {
+            x += distance;
+        }
+    }
+
+    void Turn(TrackTile tile)
+    {
+        const TurnResult result = LookupTurn(tile, direction, nextDecision);
+        direction = result.direction;
+        nextDecision = result.nextDecision;
+    }
+
+private:
+    CartId id;
+    Coordinate coordinates;
+    Direction direction;
+    TurnDecision nextDecision;
+};
+
+// Stream insertion operator for Cart.
+std::ostream & operator<<(std::ostream & stream, const Cart & cart)
+{
+    stream << cart.GetCoordinates() << ',' << cart.GetDirection();
+    return stream;
+}
+
+InputChars ReadFile(std::istream & stream)
+{
+    InputChars out;
+    string line;
+    string::size_type width = 0;
+    while (std::getline(stream, line)) {
+        width = std::max(width, line.size());
+        out.push_back(line);
+    }
+
+    const auto maxSize =
+        static_cast<string::size_type>(std::numeric_limits<int16_t>::max());
+    if (width > maxSize || out.size() > maxSize) {
+        std::cerr << "Input is too large (max = " << maxSize << " by "
+                  << maxSize << ").\n";
+        std::exit(-1);
+    }
+
+    for (auto & row : out) {
+        row.resize(width, ' ');
+    }
+    return out;
+}
+
+pair<TrackTile, MaybeCart> ProcessInputTile(const InputChars & input, int16_t x,
+                                            int16_t y)
+{
+    Coordinate coordinate = {x, y};
+    char tileChar = input[y][x];
+    if (tileChar == ' ' || tileChar == '\0') {
+        return {};
+    } else if (tileChar == '-') {
+        return {TrackTile(East | West), {}};
+    } else if (tileChar == '|') {
+        return {TrackTile(North | South), {}};
+    } else if (tileChar == '+') {
+        return {TrackTile(North | South | East | West), {}};
+    } else if (tileChar == '^') {
+        return {TrackTile(North | South), MaybeCart({coordinate, North})};
+    } else if (tileChar == 'v') {
+        return {TrackTile(North | South), MaybeCart({coordinate, South})};
+    } else if (tileChar == '<') {
+        return {TrackTile(West | East), MaybeCart({coordinate, West})};
+    } else if (tileChar == '>') {
+        return {TrackTile(West | East), MaybeCart({coordinate, East})};
+    }
+
+    // To determine the track tile of an input character, in the case of '/' and
+    // '\', we also need to consider the eight surrounding tiles.
+    char nc = (y - 1) < 0 ? ' ' : input[y - 1][x];
+    const int16_t height = input.size();
+    const int16_t width = input[y].size();
+    char sc = (y + 1) >= height ? ' ' : input[y + 1][x];
+    char wc = (x - 1) < 0 ? ' ' : input[y][x - 1];
+    char ec = (x + 1) >= width ? ' ' : input[y][x + 1];
+
+    bool n = (nc == '|') | (nc == '+') | (nc == '^') | (nc == 'v');
+    bool s = (sc == '|') | (sc == '+') | (sc == '^') | (sc == 'v');
+    bool w = (wc == '-') | (wc == '+') | (wc == '<') | (wc == '>');
+    bool e = (ec == '-') | (ec == '+') | (ec == '<') | (ec == '>');
+
+    if (tileChar == '/') {
+        if (n && w && !s && !e) {
+            return {TrackTile(North | West), {}};
+        } else if (s && e && !n && !w) {
+            return {TrackTile(South | East), {}};
+        } else {
+            std::cerr << "Invalid input at " << coordinate
+                      << ": '/' must be connected to either north and west, or "
+                         "south and east."
+                      << '\n';
+            std::exit(-1);
+        }
+    } else if (tileChar == '\\') {
+        if (n && e && !s && !w) {
+            return {TrackTile(North | East), {}};
+        } else if (s && w && !n && !e) {
+            return {TrackTile(South | West), {}};
+        } else {
+            std::cerr << "Invalid input at " << coordinate
+                      << ": '\\' must be connected to either north and east, "
+                         "or south and west."
+                      << '\n';
+            std::exit(-1);
+        }
+    }
+
+    std::cerr << "Unrecognized character '" << tileChar << "'\n";
+    std::exit(-1);
+}
+
+pair<Track, vector<Cart>> ProcessInput(const InputChars & input)
+{
+    const int16_t height = input.size();
+    const int16_t width = input.empty() ? 0 : input[0].size();
+    Track track(width, height);
+    CartId cartId = 0;
+    vector<Cart> carts;
+    for (int16_t y = 0; y < height; y++) {
+        for (int16_t x = 0; x < width; x++) {
+            auto [tile, maybeCart] = ProcessInputTile(input, x, y);
+            track.Set({x, y}, tile);
+            if (maybeCart) {
+                auto [coord, dir] = *maybeCart;
+                carts.emplace_back(cartId++, coord, dir);
+            }
+        }
+    }
+    return {track, carts};
+}
+
+pair<Track, vector<Cart>> ReadInput(std::istream & stream)
+{
+    return ProcessInput(ReadFile(stream));
+}
+
+void SortCarts(vector<Cart> & carts)
+{
+    std::sort(carts.begin(), carts.end(), [](auto & cart1, auto & cart2) {
+        auto [x1, y1] = cart1.GetCoordinates();
+        auto [x2, y2] = cart2.GetCoordinates();
+        return std::tie(y1, x1) < std::tie(y2, x2);
+    });
+}
+
+// Dense grid recording which cart, if any, is on each square of the track, so
+// collisions can be detected without comparing against every other cart.
+class Occupancy
+{
+public:
+    static constexpr CartIndex Empty = std::numeric_limits<CartIndex>::max();
+
+    Occupancy(int16_t width, int16_t height)
+        : width(width),
+          cells(static_cast<std::size_t>(width) * height, Empty)
+    {}
+
+    CartIndex & operator[](const Coordinate & coord)
+    {
+        auto [x, y] = coord;
+        return cells[static_cast<std::size_t>(y) * width + x];
+    }
+
+private:
+    int16_t width;
+    vector<CartIndex> cells;
+};
+
+using Crash = pair<pair<CartId, CartId>, Coordinate>;
+
+// Moves every cart one square, in the order they appear in "carts", removing
+// any that crash.  "occupancy" must contain only the remaining carts on entry
+// and does so again on exit, although the indexes it holds are only meaningful
+// for the duration of the call.
+vector<Crash> MoveCarts(vector<Cart> & carts, Occupancy & occupancy)
+{
+    vector<Crash> crashes;
+    vector<bool> crashed(carts.size(), false);
+
+    for (CartIndex i = 0; i < carts.size(); i++) {
+        occupancy[carts[i].GetCoordinates()] = i;
+    }
+
+    for (CartIndex i = 0; i < carts.size(); i++) {
+        if (crashed[i]) {
+            continue;
+        }
+        auto & cart = carts[i];
+        occupancy[cart.GetCoordinates()] = Occupancy::Empty;
+        cart.Move();
+        auto coord = cart.GetCoordinates();
+        CartIndex & occupant = occupancy[coord];
+        if (occupant == Occupancy::Empty) {
+            occupant = i;
+            continue;
+        }
+
+        crashes.push_back({{cart.GetId(), carts[occupant].GetId()}, coord});
+        crashed[i] = true;
+        crashed[occupant] = true;
+        occupant = Occupancy::Empty;
+    }
+
+    // Remove all crashed carts.
+    CartIndex remaining = 0;
+    for (CartIndex i = 0; i < carts.size(); i++) {
+        if (!crashed[i]) {
+            carts[remaining++] = carts[i];
+        }
+    }
+    carts.erase(carts.begin() + remaining, carts.end());
+    return crashes;
+}
+
+void TurnCarts(const Track & track, vector<Cart> & carts)
+{
+    for (auto & cart : carts) {
+        cart.Turn(track.Get(cart.GetCoordinates()));
+    }
+}
+
+// The maximal straight runs of track, so a cart travelling along one can be
+// advanced straight to the next curve or intersection.
+class TrackSegments
+{
+public:
+    using SegmentIndex = uint32_t;
+    static constexpr SegmentIndex NoSegment =
+        std::numeric_limits<SegmentIndex>::max();
+
+    // Runs shorter than "minimumLength" squares aren't counted as segments.
+    explicit TrackSegments(const Track & track, int32_t minimumLength = 1)
+        : width(track.GetWidth()), height(track.GetHeight()),
+          minimumLength(minimumLength),
+          segmentAt(static_cast<std::size_t>(width) * height, NoSegment)
+    {
+        // One row-major pass.  A horizontal run continues from the square to
+        // the west; a vertical run continues the open run of its column,
+        // which is closed by any square that isn't vertical track.
+        const auto horizontal = TrackTile(East | West);
+        const auto vertical = TrackTile(North | South);
+        vector<Run> openColumnRuns(width);
+        for (int16_t y = 0; y < height; y++) {
+            Run openRowRun;
+            for (int16_t x = 0; x < width; x++) {
+                const auto tile = track.Get({x, y});
+                Run & openColumnRun = openColumnRuns[x];
+                if (tile == horizontal) {
+                    Extend(openRowRun, {x, y}, true);
+                    openColumnRun = {};
+                } else if (tile == vertical) {
+                    Extend(openColumnRun, {x, y}, false);
+                    openRowRun = {};
+                } else {
+                    openRowRun = {};
+                    openColumnRun = {};
+                }
+            }
+        }
+    }
+
+    SegmentIndex GetCount() const { return segments.size(); }
+
+    SegmentIndex SegmentAt(const Coordinate & coord) const
+    {
+        auto [x, y] = coord;
+        if (x < 0 || x >= width || y < 0 || y >= height) {
+            return NoSegment;
+        }
+        return segmentAt[Index(coord)];
+    }
+
+    // The number of moves it takes a cart at "coord" heading in "direction"
+    // to arrive on the next curve or intersection, or 0 if it isn't
+    // travelling along a straight segment.
+    int32_t DistanceToEvent(const Coordinate & coord,
+                            Direction direction) const
+    {
+        const SegmentIndex index = SegmentAt(coord);
+        if (index == NoSegment) {
+            return 0;
+        }
+        const Segment & segment = segments[index];
+        auto [x, y] = coord;
+        if (segment.horizontal && direction == East) {
+            return segment.last.first - x + 1;
+        } else if (segment.horizontal && direction == West) {
+            return x - segment.first.first + 1;
+        } else if (!segment.horizontal && direction == South) {
+            return segment.last.second - y + 1;
+        } else if (!segment.horizontal && direction == North) {
+            return y - segment.first.second + 1;
+        }
+        return 0;
+    }
+
+private:
+    struct Segment
+    {
+        Coordinate first;
+        Coordinate last;
+        bool horizontal;
+    };
+
+    // A run of straight track which is still being scanned.  It only gets a
+    // segment once it's long enough.
+    struct Run
+    {
+        int32_t length = 0;
+        SegmentIndex segment = NoSegment;
+    };
+
+    void Extend(Run & run, const Coordinate & coord, bool horizontal)
+    {
+        run.length++;
+        if (run.segment == NoSegment) {
+            if (run.length < minimumLength) {
+                return;
+            }
+            // Fill in the squares the run has already covered.
+            run.segment = segments.size();
+            const auto [x, y] = coord;
+            const std::size_t step = horizontal ? 1 : width;
+            std::size_t index = Index(coord);
+            for (int32_t back = 1; back < run.length; back++) {
+                index -= step;
+                segmentAt[index] = run.segment;
+            }
+            const int16_t back = run.length - 1;
+            const Coordinate first = horizontal
+                                         ? Coordinate(x - back, y)
+                                         : Coordinate(x, y - back);
+            segments.push_back({first, coord, horizontal});
+        }
+        segments[run.segment].last = coord;
+        segmentAt[Index(coord)] = run.segment;
+    }
+
+    std::size_t Index(const Coordinate & coord) const
+    {
+        auto [x, y] = coord;
+        return static_cast<std::size_t>(y) * width + x;
+    }
+
+    int16_t width;
+    int16_t height;
+    int32_t minimumLength;
+    vector<SegmentIndex> segmentAt;
+    vector<Segment> segments;
+};
+
+// Simulates the carts with the same results as repeatedly calling SortCarts,
+// MoveCarts and TurnCarts, but without stepping carts one square at a time
+// where nothing can happen to them.
+//
+// A cart which is the only one on a straight segment "coasts": its position is
+// only worked out when it reaches the end of the segment, or when another cart
+// is about to move onto the segment.  Every other cart is "active" and is moved
+// tick by tick in reading order, exactly as MoveCarts would, so crashes happen
+// in the same order.  When every cart is coasting, the simulation jumps
+// straight to the next tick at which one of them wakes up.
+//
+// The per-tick work only depends on the active carts: they're kept in reading
+// order between ticks, and only carts whose segment has just gained or lost a
+// cart are checked to see whether they can start coasting.
+class SegmentJumpSimulation
+{
+public:
+    using Tick = uint64_t;
+
+    SegmentJumpSimulation(const Track & track, vector<Cart> carts)
+        : track(track), segments(track, minimumCoast),
+          carts(std::move(carts)),
+          states(this->carts.size(), CartState::Active),
+          cartSegments(this->carts.size(), TrackSegments::NoSegment),
+          coastingSince(this->carts.size(), 0),
+          wakeTick(this->carts.size(), 0),
+          segmentCarts(segments.GetCount()),
+          coastingCart(segments.GetCount(), Occupancy::Empty),
+          occupancy(track.GetWidth(), track.GetHeight()),
+          remaining(this->carts.size())
+    {
+        for (CartIndex i = 0; i < this->carts.size(); i++) {
+            const Coordinate coord = this->carts[i].GetCoordinates();
+            occupancy[coord] = i;
+            cartSegments[i] = segments.SegmentAt(coord);
+            Enter(cartSegments[i], i);
+            active.push_back(i);
+            candidates.push_back(i);
+        }
+        SortActive();
+    }
+
+    // Runs until at most one cart remains, or until "maxTicks" ticks have
+    // been simulated, and returns every crash in the order they happened.
+    vector<Crash> Run(Tick maxTicks = std::numeric_limits<Tick>::max())
+    {
+        vector<Crash> crashes;
+        Coast();
+        while (remaining > 1 && tick < maxTicks) {
+            if (active.empty()) {
+                DiscardStaleWakeups();
+                tick = std::min(wakeups.top().tick - 1, maxTicks);
+                if (tick == maxTicks) {
+                    break;
+                }
+            }
+            tick++;
+            while (!wakeups.empty() && wakeups.top().tick <= tick) {
+                const CartIndex index = wakeups.top().index;
+                wakeups.pop();
+                if (states[index] == CartState::Coasting &&
+                    wakeTick[index] == tick) {
+                    Wake(index);
+                }
+            }
+            Step(crashes);
+            Coast();
+        }
+        return crashes;
+    }
+
+    // The number of ticks simulated so far.
+    Tick GetTick() const { return tick; }
+
+    // The carts which haven't crashed, at their positions after the last
+    // simulated tick.
+    vector<Cart> GetRemainingCarts() const
+    {
+        vector<Cart> out;
+        for (CartIndex i = 0; i < carts.size(); i++) {
+            if (states[i] == CartState::Active) {
+                out.push_back(carts[i]);
+            } else if (states[i] == CartState::Coasting) {
+                Cart cart = carts[i];
+                cart.Move(tick - coastingSince[i]);
+                out.push_back(cart);
+            }
+        }
+        return out;
+    }
+
+private:
+    enum class CartState : uint8_t
+    {
+        Active,
+        Coasting,
+        Crashed,
+    };
+
+    // Carts woken on the same tick are put in reading order by SortActive,
+    // so only the tick matters here.
+    struct Wakeup
+    {
+        Tick tick;
+        CartIndex index;
+
+        bool operator>(const Wakeup & other) const
+        {
+            return tick > other.tick;
+        }
+    };
+
+    // Coasting a cart costs more than stepping it a few squares, so it's only
+    // done for carts with at least this far to go.
+    static constexpr int32_t minimumCoast = 8;
+
+    // The carts on a segment.  While there's only one, "indexes" is its
+    // index, as every other index has been XORed in and out again.
+    struct SegmentCarts
+    {
+        uint32_t count = 0;
+        CartIndex indexes = 0;
+    };
+
+    void Enter(TrackSegments::SegmentIndex segment, CartIndex index)
+    {
+        if (segment == TrackSegments::NoSegment) {
+            return;
+        }
+        segmentCarts[segment].count++;
+        segmentCarts[segment].indexes ^= index;
+    }
+
+    // Takes a cart off a segment, and if that leaves a single cart behind,
+    // checks whether it can coast.
+    void Leave(TrackSegments::SegmentIndex segment, CartIndex index)
+    {
+        if (segment == TrackSegments::NoSegment) {
+            return;
+        }
+        SegmentCarts & onSegment = segmentCarts[segment];
+        onSegment.count--;
+        onSegment.indexes ^= index;
+        if (onSegment.count == 1) {
+            candidates.push_back(onSegment.indexes);
+        }
+    }
+
+    // The segment of the square the cart will move onto next, if any.
+    TrackSegments::SegmentIndex SegmentAhead(Cart cart) const
+    {
+        cart.Move();
+        return segments.SegmentAt(cart.GetCoordinates());
+    }
+
+    uint32_t ReadingOrder(CartIndex index) const
+    {
+        auto [x, y] = carts[index].GetCoordinates();
+        return (static_cast<uint32_t>(y) << 16) | static_cast<uint16_t>(x);
+    }
+
+    // Puts the active carts back in reading order.  Carts only move one
+    // square per tick and woken carts are few, so the list is always nearly
+    // sorted and an insertion sort takes close to linear time.
+    void SortActive()
+    {
+        for (std::size_t i = 1; i < active.size(); i++) {
+            const CartIndex index = active[i];
+            const uint32_t order = ReadingOrder(index);
+            std::size_t j = i;
+            for (; j > 0 && ReadingOrder(active[j - 1]) > order; j--) {
+                active[j] = active[j - 1];
+            }
+            active[j] = index;
+        }
+    }
+
+    void DiscardStaleWakeups()
+    {
+        while (states[wakeups.top().index] != CartState::Coasting ||
+               wakeTick[wakeups.top().index] != wakeups.top().tick) {
+            wakeups.pop();
+        }
+    }
+
+    // Works out where a coasting cart is at the start of the current tick and
+    // makes it active again.
+    void Wake(CartIndex index)
+    {
+        Cart & cart = carts[index];
+        cart.Move(tick - 1 - coastingSince[index]);
+        states[index] = CartState::Active;
+        coastingCount--;
+        coastingCart[segments.SegmentAt(cart.GetCoordinates())] =
+            Occupancy::Empty;
+        occupancy[cart.GetCoordinates()] = index;
+        active.push_back(index);
+        // If whatever woke it crashes before reaching its segment, it can
+        // coast again straight away.
+        candidates.push_back(index);
+    }
+
+    // Simulates one tick for the active carts.
+    void Step(vector<Crash> & crashes)
+    {
+        // Any cart about to move onto a segment must be able to see a cart
+        // coasting along it.  Only carts which aren't on a segment can be
+        // about to move onto one, and carts woken here finish their segment
+        // before they can reach another.
+        if (coastingCount > 0) {
+            const auto activeAtStart = active.size();
+            for (std::size_t i = 0; i < activeAtStart; i++) {
+                if (cartSegments[active[i]] != TrackSegments::NoSegment) {
+                    continue;
+                }
+                const auto segment = SegmentAhead(carts[active[i]]);
+                if (segment != TrackSegments::NoSegment &&
+                    coastingCart[segment] != Occupancy::Empty) {
+                    Wake(coastingCart[segment]);
+                }
+            }
+        }
+        SortActive();
+
+        for (CartIndex index : active) {
+            if (states[index] == CartState::Crashed) {
+                continue;
+            }
+            Cart & cart = carts[index];
+            const Coordinate from = cart.GetCoordinates();
+            occupancy[from] = Occupancy::Empty;
+            cart.Move();
+            const Coordinate to = cart.GetCoordinates();
+
+            const auto fromSegment = cartSegments[index];
+            const auto toSegment = segments.SegmentAt(to);
+            if (fromSegment != toSegment) {
+                Leave(fromSegment, index);
+                Enter(toSegment, index);
+                cartSegments[index] = toSegment;
+            }
+
+            CartIndex & occupant = occupancy[to];
+            if (occupant == Occupancy::Empty) {
+                occupant = index;
+                cart.Turn(track.Get(to));
+                // Having just arrived, it has the whole segment to go.
+                if (fromSegment != toSegment &&
+                    toSegment != TrackSegments::NoSegment) {
+                    candidates.push_back(index);
+                }
+                continue;
+            }
+
+            crashes.push_back({{cart.GetId(), carts[occupant].GetId()}, to});
+            states[index] = CartState::Crashed;
+            states[occupant] = CartState::Crashed;
+            Leave(toSegment, index);
+            Leave(toSegment, occupant);
+            occupant = Occupancy::Empty;
+            remaining -= 2;
+            leftActive = true;
+        }
+    }
+
+    // Lets every candidate which is alone on a segment coast until it reaches
+    // the end of it, then drops any carts which are no longer active.
+    void Coast()
+    {
+        for (CartIndex index : candidates) {
+            if (states[index] != CartState::Active) {
+                continue;
+            }
+            const Cart & cart = carts[index];
+            const Coordinate coord = cart.GetCoordinates();
+            const auto segment = cartSegments[index];
+            if (segment == TrackSegments::NoSegment ||
+                segmentCarts[segment].count != 1) {
+                continue;
+            }
+            const auto distance =
+                segments.DistanceToEvent(coord, cart.GetDirection());
+            if (distance < minimumCoast) {
+                continue;
+            }
+
+            // The cart arrives at the end of the segment during tick
+            // (tick + distance), so it has to be active by then.
+            states[index] = CartState::Coasting;
+            coastingCount++;
+            coastingSince[index] = tick;
+            wakeTick[index] = tick + distance;
+            coastingCart[segment] = index;
+            occupancy[coord] = Occupancy::Empty;
+            wakeups.push({wakeTick[index], index});
+            leftActive = true;
+        }
+        candidates.clear();
+
+        if (leftActive) {
+            active.erase(std::remove_if(active.begin(), active.end(),
+                                        [&](auto index) {
+                                            return states[index] !=
+                                                   CartState::Active;
+                                        }),
+                         active.end());
+            leftActive = false;
+        }
+    }
+
+    const Track & track;
+    TrackSegments segments;
+    vector<Cart> carts;
+    vector<CartState> states;
+    // The segment each cart is on, if any.
+    vector<TrackSegments::SegmentIndex> cartSegments;
+    vector<Tick> coastingSince;
+    vector<Tick> wakeTick;
+    vector<SegmentCarts> segmentCarts;
+    vector<CartIndex> coastingCart;
+    // The active carts, in reading order at the start of each tick.
+    vector<CartIndex> active;
+    // Carts which might be able to start coasting at the end of this tick.
+    vector<CartIndex> candidates;
+    Occupancy occupancy;
+    std::priority_queue<Wakeup, vector<Wakeup>, std::greater<>> wakeups;
+    Tick tick = 0;
+    CartIndex remaining;
+    CartIndex coastingCount = 0;
+    // Set when a cart has crashed or started coasting, so "active" needs
+    // tidying.
+    bool leftActive = false;
+};
+
+} // namespace day13
+
+#endif // AOC_DAY13_HPP
@@ -0,0 +1,96 @@
+// Copyright (C) 2018 David Holmes <dholmes@dholmes.us>. All rights reserved.
+
+// Benchmark for the day13 segment-jump simulation against the tick-by-tick
+// loop, on a generated track of rectangular loops.  Building the segment
+// table is timed separately from the run, as it's paid once per track.
+
+#include "day13.hpp"
+#include "day13test.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <random>
+
+using namespace day13;
+
+using Tick = SegmentJumpSimulation::Tick;
+
+template <typename Function> double TimeSeconds(Function && function)
+{
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+template <typename T> void ParseArg(int argc, char ** argv, int i, T & value)
+{
+    if (argc > i) {
+        std::from_chars(argv[i], argv[i] + std::strlen(argv[i]), value);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    int16_t size = 2000;
+    int32_t loopCount = 100;
+    int32_t cartCount = 101;
+    Tick maxTicks = 1000000;
+    ParseArg(argc, argv, 1, size);
+    ParseArg(argc, argv, 2, loopCount);
+    ParseArg(argc, argv, 3, cartCount);
+    ParseArg(argc, argv, 4, maxTicks);
+
+    std::mt19937 random(13);
+    const auto input =
+        ProcessInput(MakeLoopTrack(size, loopCount, cartCount, random));
+    const Track & track = input.first;
+
+    vector<Crash> reference;
+    Tick referenceTicks = 0;
+    uint64_t cartSteps = 0;
+    const double referenceSeconds = TimeSeconds([&]() {
+        vector<Cart> carts = input.second;
+        Occupancy occupancy(track.GetWidth(), track.GetHeight());
+        while (carts.size() > 1 && referenceTicks < maxTicks) {
+            cartSteps += carts.size();
+            SortCarts(carts);
+            for (auto & crash : MoveCarts(carts, occupancy)) {
+                reference.push_back(crash);
+            }
+            TurnCarts(track, carts);
+            referenceTicks++;
+        }
+    });
+
+    std::optional<SegmentJumpSimulation> simulation;
+    const double setupSeconds =
+        TimeSeconds([&]() { simulation.emplace(track, input.second); });
+    vector<Crash> jumped;
+    const double jumpSeconds =
+        TimeSeconds([&]() { jumped = simulation->Run(maxTicks); });
+
+    if (reference != jumped || referenceTicks != simulation->GetTick()) {
+        std::cerr << "Mismatch: " << reference.size() << " crashes in "
+                  << referenceTicks << " ticks, against " << jumped.size()
+                  << " in " << simulation->GetTick() << '\n';
+        return 1;
+    }
+
+    std::cout << "Track:        " << size << "x" << size << ", " << loopCount
+              << " loops, " << cartCount << " carts, " << referenceTicks
+              << " ticks, " << reference.size() << " crashes\n";
+    std::cout << "Tick by tick: " << referenceSeconds << " s ("
+              << (cartSteps / referenceSeconds / 1e6) << "M cart-steps/s)\n";
+    std::cout << "Segment jump: " << jumpSeconds << " s ("
+              << (cartSteps / jumpSeconds / 1e6) << "M cart-steps/s, "
+              << (referenceSeconds / jumpSeconds) << "x) + " << setupSeconds
+              << " s setup\n";
+
+    return 0;
+}
@@ -0,0 +1,249 @@
+// Copyright (C) 2018 David Holmes <dholmes@dholmes.us>. All rights reserved.
+
+#include "day13.hpp"
+#include "day13test.hpp"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+
+using namespace day13;
+
+// The original if-chain implementation of Cart::Turn, kept as a reference for
+// the turn table.
+TurnResult ReferenceTurn(TrackTile tile, Direction direction,
+                         TurnDecision nextDecision)
+{
+    auto newDirection = [](Direction oldDirection, TurnDecision turnDecision) {
+        if (turnDecision == TurnDecision::Straight) {
+            return oldDirection;
+        } else if (turnDecision == TurnDecision::Left) {
+            if (oldDirection == North) {
+                return West;
+            } else if (oldDirection == West) {
+                return South;
+            } else if (oldDirection == South) {
+                return East;
+            } else if (oldDirection == East) {
+                return North;
+            }
+        } else if (turnDecision == TurnDecision::Right) {
+            if (oldDirection == North) {
+                return East;
+            } else if (oldDirection == East) {
+                return South;
+            } else if (oldDirection == South) {
+                return West;
+            } else if (oldDirection == West) {
+                return North;
+            }
+        }
+        return North;
+    };
+
+    if (tile == TrackTile(North | South) || tile == TrackTile(East | West)) {
+        return {direction, nextDecision};
+    } else if (tile == TrackTile(North | East)) {
+        if (direction == South) {
+            direction = East;
+        } else if (direction == West) {
+            direction = North;
+        }
+    } else if (tile == TrackTile(South | West)) {
+        if (direction == North) {
+            direction = West;
+        } else if (direction == East) {
+            direction = South;
+        }
+    } else if (tile == TrackTile(North | West)) {
+        if (direction == South) {
+            direction = West;
+        } else if (direction == East) {
+            direction = North;
+        }
+    } else if (tile == TrackTile(South | East)) {
+        if (direction == North) {
+            direction = East;
+        } else if (direction == West) {
+            direction = South;
+        }
+    } else if (tile == TrackTile(North | South | West | East)) {
+        direction = newDirection(direction, nextDecision);
+        nextDecision = static_cast<TurnDecision>(
+            (static_cast<uint8_t>(nextDecision) + 1) % 3);
+    }
+    return {direction, nextDecision};
+}
+
+TEST(TurnTableTest, MatchesReferenceForEveryTileDirectionAndDecision)
+{
+    for (uint8_t tile = 0; tile < 16; tile++) {
+        for (Direction direction : {North, East, South, West}) {
+            for (uint8_t d = 0; d < 3; d++) {
+                const auto decision = static_cast<TurnDecision>(d);
+                const TurnResult expected =
+                    ReferenceTurn(TrackTile(tile), direction, decision);
+                const TurnResult actual =
+                    LookupTurn(TrackTile(tile), direction, decision);
+                EXPECT_EQ(expected.direction, actual.direction)
+                    << "tile=" << static_cast<int>(tile)
+                    << " direction=" << direction << " decision=" << int(d);
+                EXPECT_EQ(expected.nextDecision, actual.nextDecision)
+                    << "tile=" << static_cast<int>(tile)
+                    << " direction=" << direction << " decision=" << int(d);
+            }
+        }
+    }
+}
+
+TEST(MoveCartsTest, Example)
+{
+    const char * const exampleInputStr = "/->-\\        \n"
+                                         "|   |  /----\\\n"
+                                         "| /-+--+-\\  |\n"
+                                         "| | |  | v  |\n"
+                                         "\\-+-/  \\-+--/\n"
+                                         "  \\------/   \n";
+
+    auto [track, carts] = [=]() {
+        std::stringstream ss;
+        ss << exampleInputStr;
+        return ReadInput(ss);
+    }();
+
+    Occupancy occupancy(track.GetWidth(), track.GetHeight());
+    vector<Crash> crashes;
+    int tick = 0;
+    while (crashes.empty()) {
+        SortCarts(carts);
+        crashes = MoveCarts(carts, occupancy);
+        TurnCarts(track, carts);
+        tick++;
+    }
+
+    const Coordinate expectedCrash = {7, 3};
+    ASSERT_EQ(14, tick);
+    ASSERT_EQ(expectedCrash, crashes[0].second);
+    ASSERT_TRUE(carts.empty());
+}
+
+TEST(MoveCartsTest, CrashedCartsAreRemovedImmediately)
+{
+    // The two carts either side of the intersection crash on it, and then,
+    // in the same tick, the third drives onto the now empty square.
+    const char * const exampleInputStr = " | \n"
+                                         ">+<\n"
+                                         " ^ \n";
+
+    auto [track, carts] = [=]() {
+        std::stringstream ss;
+        ss << exampleInputStr;
+        return ReadInput(ss);
+    }();
+
+    Occupancy occupancy(track.GetWidth(), track.GetHeight());
+    SortCarts(carts);
+    const vector<Crash> crashes = MoveCarts(carts, occupancy);
+
+    const Coordinate intersection = {1, 1};
+    const vector<Crash> expectedCrashes = {{{1, 0}, intersection}};
+    ASSERT_EQ(expectedCrashes, crashes);
+    ASSERT_EQ(1u, carts.size());
+    ASSERT_EQ(2u, carts[0].GetId());
+    ASSERT_EQ(intersection, carts[0].GetCoordinates());
+}
+
+TEST(SegmentJumpSimulationTest, MatchesTickByTickSimulation)
+{
+    const char * const exampleInputStr = "/>-<\\  \n"
+                                         "|   |  \n"
+                                         "| /<+-\\\n"
+                                         "| | | v\n"
+                                         "\\>+</ |\n"
+                                         "  |   ^\n"
+                                         "  \\<->/\n";
+
+    auto [track, carts] = [=]() {
+        std::stringstream ss;
+        ss << exampleInputStr;
+        return ReadInput(ss);
+    }();
+
+    SegmentJumpSimulation simulation(track, carts);
+    const vector<Crash> crashes = simulation.Run();
+    const vector<Cart> remaining = simulation.GetRemainingCarts();
+
+    Occupancy occupancy(track.GetWidth(), track.GetHeight());
+    vector<Crash> expectedCrashes;
+    SegmentJumpSimulation::Tick expectedTick = 0;
+    while (carts.size() > 1) {
+        SortCarts(carts);
+        for (auto & crash : MoveCarts(carts, occupancy)) {
+            expectedCrashes.push_back(crash);
+        }
+        TurnCarts(track, carts);
+        expectedTick++;
+    }
+
+    ASSERT_EQ(expectedCrashes, crashes);
+    ASSERT_EQ(expectedTick, simulation.GetTick());
+    ASSERT_EQ(1u, remaining.size());
+    const Coordinate expectedCoordinates = {6, 4};
+    ASSERT_EQ(expectedCoordinates, remaining[0].GetCoordinates());
+    ASSERT_EQ(carts[0].GetDirection(), remaining[0].GetDirection());
+}
+
+TEST(SegmentJumpSimulationTest, MatchesTickByTickSimulationOnRandomTracks)
+{
+    // Carts can chase each other around a loop forever, so both simulations
+    // stop at the same tick if they haven't finished by then.
+    const SegmentJumpSimulation::Tick maxTicks = 3000;
+    std::mt19937 random(13);
+    std::uniform_int_distribution<int32_t> loopCount(1, 12);
+    std::uniform_int_distribution<int32_t> cartCount(2, 25);
+    auto byId = [](const Cart & cart1, const Cart & cart2) {
+        return cart1.GetId() < cart2.GetId();
+    };
+    for (int round = 0; round < 300; round++) {
+        auto [track, carts] = ProcessInput(
+            MakeLoopTrack(60, loopCount(random), cartCount(random), random));
+
+        SegmentJumpSimulation simulation(track, carts);
+        const vector<Crash> crashes = simulation.Run(maxTicks);
+        vector<Cart> remaining = simulation.GetRemainingCarts();
+
+        Occupancy occupancy(track.GetWidth(), track.GetHeight());
+        vector<Crash> expectedCrashes;
+        SegmentJumpSimulation::Tick expectedTick = 0;
+        while (carts.size() > 1 && expectedTick < maxTicks) {
+            SortCarts(carts);
+            for (auto & crash : MoveCarts(carts, occupancy)) {
+                expectedCrashes.push_back(crash);
+            }
+            TurnCarts(track, carts);
+            expectedTick++;
+        }
+
+        ASSERT_EQ(expectedCrashes, crashes) << "round " << round;
+        ASSERT_EQ(expectedTick, simulation.GetTick()) << "round " << round;
+        ASSERT_EQ(carts.size(), remaining.size()) << "round " << round;
+        std::sort(carts.begin(), carts.end(), byId);
+        std::sort(remaining.begin(), remaining.end(), byId);
+        for (std::size_t i = 0; i < carts.size(); i++) {
+            ASSERT_EQ(carts[i].GetId(), remaining[i].GetId());
+            ASSERT_EQ(carts[i].GetCoordinates(), remaining[i].GetCoordinates())
+                << "round " << round << " cart " << carts[i].GetId();
+            ASSERT_EQ(carts[i].GetDirection(), remaining[i].GetDirection())
+                << "round " << round << " cart " << carts[i].GetId();
+        }
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,87 @@
+// Copyright (C) 2018 David Holmes <dholmes@dholmes.us>. All rights reserved.
+
+#ifndef AOC_DAY13TEST_HPP
+#define AOC_DAY13TEST_HPP
+
+#include "day13.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <random>
+
+using namespace day13;
+
+// Lays out "loopCount" rectangular loops of track at random on a square grid
+// "size" wide, with "cartCount" carts at random on their straight pieces.
+// Every corner gets its own even row and column, so loops only meet at
+// intersections and no curve has other track beside it.
+InputChars MakeLoopTrack(int16_t size, int32_t loopCount, int32_t cartCount,
+                         std::mt19937 & random)
+{
+    vector<int16_t> columns;
+    for (int16_t i = 0; i < size; i += 2) {
+        columns.push_back(i);
+    }
+    assert(columns.size() >= 2 * static_cast<std::size_t>(loopCount));
+    vector<int16_t> rows = columns;
+    std::shuffle(columns.begin(), columns.end(), random);
+    std::shuffle(rows.begin(), rows.end(), random);
+
+    struct Loop
+    {
+        int16_t left;
+        int16_t right;
+        int16_t top;
+        int16_t bottom;
+    };
+    vector<Loop> loops;
+    for (int32_t i = 0; i < loopCount; i++) {
+        auto [left, right] = std::minmax(columns[2 * i], columns[2 * i + 1]);
+        auto [top, bottom] = std::minmax(rows[2 * i], rows[2 * i + 1]);
+        loops.push_back({left, right, top, bottom});
+    }
+
+    InputChars out(size, string(size, ' '));
+    for (const Loop & loop : loops) {
+        for (int16_t y = loop.top + 1; y < loop.bottom; y++) {
+            out[y][loop.left] = '|';
+            out[y][loop.right] = '|';
+        }
+    }
+    for (const Loop & loop : loops) {
+        for (int16_t x = loop.left + 1; x < loop.right; x++) {
+            for (int16_t y : {loop.top, loop.bottom}) {
+                out[y][x] = out[y][x] == '|' ? '+' : '-';
+            }
+        }
+        out[loop.top][loop.left] = '/';
+        out[loop.top][loop.right] = '\\';
+        out[loop.bottom][loop.left] = '\\';
+        out[loop.bottom][loop.right] = '/';
+    }
+
+    vector<Coordinate> straights;
+    for (int16_t y = 0; y < size; y++) {
+        for (int16_t x = 0; x < size; x++) {
+            if (out[y][x] == '-' || out[y][x] == '|') {
+                straights.push_back({x, y});
+            }
+        }
+    }
+    std::shuffle(straights.begin(), straights.end(), random);
+    std::bernoulli_distribution forwards;
+    const auto placed =
+        std::min(static_cast<std::size_t>(cartCount), straights.size());
+    for (std::size_t i = 0; i < placed; i++) {
+        auto [x, y] = straights[i];
+        char & tile = out[y][x];
+        if (tile == '-') {
+            tile = forwards(random) ? '>' : '<';
+        } else {
+            tile = forwards(random) ? 'v' : '^';
+        }
+    }
+    return out;
+}
+
+#endif // AOC_DAY13TEST_HPP
@@ -1,58 +1,86 @@
 // Copyright (C) 2018 David Holmes <dholmes@dholmes.us>. All rights reserved.
 
+#include "day14.hpp"
+
 #include "ansiterm.hpp"
 
 #include <algorithm>
 #include <cstdint>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <vector>
 
+using namespace day14;
+
+using std::optional;
+using std::string;
 using std::uint32_t;
-using std::uint64_t;
-using std::uint8_t;
 using std::vector;
 
-using RecipeScore = uint8_t;
-using ScoreIndex = vector<RecipeScore>::size_type;
-
-void AppendNewScores(vector<RecipeScore> & scores, RecipeScore elf1,
-                     RecipeScore elf2)
+uint32_t ReadInput(std::istream & stream)
 {
-    auto sum = elf1 + elf2;
-    if (sum == 0) {
-        scores.push_back(0);
-        return;
-    }
-    if (sum >= 10) {
-        scores.push_back(1);
-    }
-    scores.push_back(sum % 10);
+    uint32_t input;
+    stream >> input;
+    return input;
 }
 
-vector<RecipeScore> ScoresFromInteger(uint32_t i)
+// Reads one target sequence of digits per line.
+vector<vector<RecipeScore>> ReadTargets(std::istream & stream)
 {
-    vector<RecipeScore> out;
-    if (i == 0) {
-        return {0};
-    }
-    while (i > 0) {
-        out.insert(out.begin(), i % 10);
-        i /= 10;
+    vector<vector<RecipeScore>> out;
+    string line;
+    while (std::getline(stream, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        vector<RecipeScore> target;
+        for (char c : line) {
+            if (c < '0' || c > '9') {
+                std::cerr << "Invalid target \"" << line << "\"\n";
+                std::exit(1);
+            }
+            target.push_back(c - '0');
+        }
+        out.push_back(target);
     }
     return out;
 }
 
-uint32_t ReadInput(std::istream & stream)
+// Finds the first occurrence of every target sequence in one pass over the
+// recipes, stopping as soon as they have all been found.
+void SearchForTargets(std::istream & stream)
 {
-    uint32_t input;
-    stream >> input;
-    return input;
+    const vector<vector<RecipeScore>> targets = ReadTargets(stream);
+    Scoreboard scores = {3, 7};
+    ScoreIndex elf1 = 0;
+    ScoreIndex elf2 = 1;
+
+    MultiScoreMatcher matcher(targets);
+    ScoreIndex scoresMatched = 0;
+    while (!matcher.AllFound()) {
+        for (; scoresMatched < scores.Size() && !matcher.AllFound();
+             scoresMatched++) {
+            matcher.Feed(scores[scoresMatched], scoresMatched);
+        }
+        MakeRecipes(scores, elf1, elf2);
+    }
+
+    auto & firstOccurrences = matcher.GetFirstOccurrences();
+    for (std::size_t t = 0; t < targets.size(); t++) {
+        std::cout << "Number of recipes to the left of \"";
+        for (RecipeScore score : targets[t]) {
+            std::cout << static_cast<int>(score);
+        }
+        std::cout << "\": " << *firstOccurrences[t] << '\n';
+    }
 }
 
-void PrintScores(std::ostream & stream, const vector<RecipeScore> & scores,
+void PrintScores(std::ostream & stream, const Scoreboard & scores,
                  ScoreIndex elf1, ScoreIndex elf2)
 {
-    for (ScoreIndex i = 0; i < scores.size(); i++) {
+    for (ScoreIndex i = 0; i < scores.Size(); i++) {
         if (i == elf1) {
             stream << ansi::graphic::fg_color(ansi::graphic::color3::red);
         } else if (i == elf2) {
@@ -64,34 +92,36 @@ void PrintScores(std::ostream & stream, const vector<RecipeScore> & scores,
     stream << '\n';
 }
 
-int main(int /*argc*/, char ** /*argv*/)
+int main(int argc, char ** argv)
 {
-    vector<RecipeScore> scores = {3, 7};
+    if (argc == 2 && std::string_view(argv[1]) == "--targets") {
+        SearchForTargets(std::cin);
+        return 0;
+    } else if (argc != 1) {
+        std::cerr << "USAGE: " << argv[0] << " [--targets] < input.txt\n";
+        return 1;
+    }
+
+    Scoreboard scores = {3, 7};
     auto input = ReadInput(std::cin);
     vector<RecipeScore> part2TargetScores = ScoresFromInteger(input);
+    scores.Reserve(input + 11);
     ScoreIndex elf1 = 0;
     ScoreIndex elf2 = 1;
 
-    bool part2Solved = false;
-    ScoreIndex part2Solution = 0;
+    ScoreMatcher matcher(part2TargetScores);
+    ScoreIndex scoresMatched = 0;
+    optional<ScoreIndex> part2Solution;
 
-    while (!part2Solved) {
-
-        for (int i = 0; i < 1000000; i++) {
-
-            AppendNewScores(scores, scores[elf1], scores[elf2]);
-            auto scoresSize = scores.size();
-            elf1 = ((elf1 + 1 + scores[elf1]) % scoresSize);
-            elf2 = ((elf2 + 1 + scores[elf2]) % scoresSize);
-            // PrintScores(std::cout, scores, elf1, elf2);
-        }
+    while (!part2Solution || scores.Size() < input + 10) {
+        MakeRecipes(scores, elf1, elf2);
+        auto scoresSize = scores.Size();
+        // PrintScores(std::cout, scores, elf1, elf2);
 
-        auto s =
-            std::search(scores.begin(), scores.end(), part2TargetScores.begin(),
-                        part2TargetScores.end());
-        if (s != scores.end()) {
-            part2Solved = true;
-            part2Solution = s - scores.begin();
+        for (; scoresMatched < scoresSize; scoresMatched++) {
+            if (!part2Solution && matcher.Feed(scores[scoresMatched])) {
+                part2Solution = scoresMatched + 1 - part2TargetScores.size();
+            }
         }
     }
 
@@ -102,7 +132,7 @@ int main(int /*argc*/, char ** /*argv*/)
     std::cout << '\n';
 
     std::cout << "Number of recipes to the left of \"" << input
-              << "\": " << part2Solution << '\n';
+              << "\": " << *part2Solution << '\n';
 
     return 0;
 }
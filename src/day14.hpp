@@ -0,0 +1,282 @@
+// Copyright (C) 2018 David Holmes <dholmes@dholmes.us>. All rights reserved.
+
+#ifndef AOC_DAY14_HPP
+#define AOC_DAY14_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <vector>
+
+namespace day14 {
+
+using std::array;
+using std::optional;
+using std::uint32_t;
+using std::uint8_t;
+using std::vector;
+
+using RecipeScore = uint8_t;
+using ScoreIndex = std::size_t;
+
+// The one or two scores made from a pair of elves' scores: a sum of 0-9 makes
+// one recipe with that score, and 10-18 makes a 1 followed by (sum - 10).
+struct NewScores
+{
+    uint8_t count;
+    RecipeScore first;
+    RecipeScore second;
+};
+
+constexpr array<NewScores, 19> MakeNewScoresTable()
+{
+    array<NewScores, 19> table = {};
+    for (uint8_t sum = 0; sum < table.size(); sum++) {
+        if (sum < 10) {
+            table[sum] = {1, sum, 0};
+        } else {
+            table[sum] = {2, 1, static_cast<RecipeScore>(sum - 10)};
+        }
+    }
+    return table;
+}
+
+constexpr array<NewScores, 19> newScoresTable = MakeNewScoresTable();
+
+// The scoreboard, with two scores packed into each byte: the score at an even
+// index in the low four bits and the next one in the high four bits.
+class Scoreboard
+{
+public:
+    Scoreboard(std::initializer_list<RecipeScore> initialScores)
+    {
+        for (RecipeScore score : initialScores) {
+            Append(newScoresTable[score]);
+        }
+    }
+
+    // Allocates room for "count" scores without filling it in, so the board
+    // doesn't have to reallocate as it grows that far.
+    void Reserve(ScoreIndex count) { bytes.reserve(count / 2 + 1); }
+
+    ScoreIndex Size() const { return size; }
+
+    RecipeScore operator[](ScoreIndex i) const
+    {
+        return (bytes[i / 2] >> (i % 2 * 4)) & 0xF;
+    }
+
+    // Always writes two scores, but only keeps the second if there are two.
+    // The space beyond the end of the board is overwritten by the next call.
+    void Append(const NewScores & scores)
+    {
+        if (size + 2 > bytes.size() * 2) {
+            bytes.resize(std::max<ScoreIndex>(bytes.size() * 2, 32));
+        }
+        SetScore(size, scores.first);
+        SetScore(size + 1, scores.second);
+        size += scores.count;
+    }
+
+private:
+    void SetScore(ScoreIndex i, RecipeScore score)
+    {
+        const auto shift = i % 2 * 4;
+        uint8_t & byte = bytes[i / 2];
+        byte = (byte & ~(0xF << shift)) | (score << shift);
+    }
+
+    vector<uint8_t> bytes;
+    ScoreIndex size = 0;
+};
+
+void AppendNewScores(Scoreboard & scores, RecipeScore elf1, RecipeScore elf2)
+{
+    scores.Append(newScoresTable[elf1 + elf2]);
+}
+
+// Moves an elf forward (1 + score) recipes, wrapping around the board.  An elf
+// moves at most 10 recipes, so once the board has more than 10 scores a single
+// conditional subtract does the job of %.
+ScoreIndex AdvanceElf(ScoreIndex elf, RecipeScore score, ScoreIndex boardSize)
+{
+    elf += 1 + score;
+    if (boardSize <= 10) {
+        return elf % boardSize;
+    }
+    return elf >= boardSize ? elf - boardSize : elf;
+}
+
+// Makes one round of new recipes and moves both elves.
+void MakeRecipes(Scoreboard & scores, ScoreIndex & elf1, ScoreIndex & elf2)
+{
+    const RecipeScore score1 = scores[elf1];
+    const RecipeScore score2 = scores[elf2];
+    AppendNewScores(scores, score1, score2);
+    const ScoreIndex size = scores.Size();
+    elf1 = AdvanceElf(elf1, score1, size);
+    elf2 = AdvanceElf(elf2, score2, size);
+}
+
+vector<RecipeScore> ScoresFromInteger(uint32_t i)
+{
+    vector<RecipeScore> out;
+    if (i == 0) {
+        return {0};
+    }
+    while (i > 0) {
+        out.insert(out.begin(), i % 10);
+        i /= 10;
+    }
+    return out;
+}
+
+// Knuth-Morris-Pratt automaton which finds a sequence of scores in a stream
+// fed to it one score at a time, so only newly appended scores need checking.
+class ScoreMatcher
+{
+public:
+    explicit ScoreMatcher(const vector<RecipeScore> & target)
+        : transitions(target.size() + 1), state(0)
+    {
+        // transitions[s][d] is the length of the longest prefix of the target
+        // which is a suffix of (the first s scores of the target, then d).
+        ScoreIndex fallback = 0;
+        for (ScoreIndex s = 0; s <= target.size(); s++) {
+            for (RecipeScore d = 0; d < 10; d++) {
+                transitions[s][d] = transitions[fallback][d];
+            }
+            if (s < target.size()) {
+                transitions[s][target[s]] = s + 1;
+                if (s > 0) {
+                    fallback = transitions[fallback][target[s]];
+                }
+            }
+        }
+    }
+
+    // Returns true if the target ends with this score.
+    bool Feed(RecipeScore score)
+    {
+        state = transitions[state][score];
+        return state == transitions.size() - 1;
+    }
+
+private:
+    vector<array<ScoreIndex, 10>> transitions;
+    ScoreIndex state;
+};
+
+// Aho-Corasick automaton which finds the first occurrence of each of several
+// sequences of scores in a stream fed to it one score at a time.
+class MultiScoreMatcher
+{
+public:
+    using TargetIndex = uint32_t;
+
+    explicit MultiScoreMatcher(const vector<vector<RecipeScore>> & targets)
+        : transitions(1), suffixLink(1, 0), outputLink(1, NoState),
+          targetsEndingAt(1), firstOccurrences(targets.size()),
+          targetLengths(targets.size()), targetsRemaining(targets.size()),
+          state(0)
+    {
+        // Build a trie of the targets.
+        for (auto & row : transitions) {
+            row.fill(NoState);
+        }
+        for (TargetIndex t = 0; t < targets.size(); t++) {
+            State s = 0;
+            for (RecipeScore score : targets[t]) {
+                if (transitions[s][score] == NoState) {
+                    transitions[s][score] = transitions.size();
+                    transitions.emplace_back();
+                    transitions.back().fill(NoState);
+                    suffixLink.push_back(0);
+                    outputLink.push_back(NoState);
+                    targetsEndingAt.emplace_back();
+                }
+                s = transitions[s][score];
+            }
+            targetsEndingAt[s].push_back(t);
+            targetLengths[t] = targets[t].size();
+        }
+
+        // Breadth-first, fill in the suffix links and turn the trie into a
+        // complete automaton, so each score is a single transition.
+        std::queue<State> queue;
+        for (RecipeScore d = 0; d < 10; d++) {
+            State & next = transitions[0][d];
+            if (next == NoState) {
+                next = 0;
+            } else {
+                queue.push(next);
+            }
+        }
+        while (!queue.empty()) {
+            const State s = queue.front();
+            queue.pop();
+            for (RecipeScore d = 0; d < 10; d++) {
+                State & next = transitions[s][d];
+                const State fallback = transitions[suffixLink[s]][d];
+                if (next == NoState) {
+                    next = fallback;
+                    continue;
+                }
+                suffixLink[next] = fallback;
+                outputLink[next] = targetsEndingAt[fallback].empty()
+                                       ? outputLink[fallback]
+                                       : fallback;
+                queue.push(next);
+            }
+        }
+    }
+
+    // Feeds the score at "index" in the stream, recording any targets which
+    // end with it for the first time.
+    void Feed(RecipeScore score, ScoreIndex index)
+    {
+        state = transitions[state][score];
+        State s = targetsEndingAt[state].empty() ? outputLink[state] : state;
+        for (; s != NoState; s = outputLink[s]) {
+            for (TargetIndex t : targetsEndingAt[s]) {
+                if (!firstOccurrences[t]) {
+                    firstOccurrences[t] = index + 1 - targetLengths[t];
+                    targetsRemaining--;
+                }
+            }
+        }
+    }
+
+    bool AllFound() const { return targetsRemaining == 0; }
+
+    // The number of scores before the first occurrence of each target, in
+    // the order the targets were given.
+    const vector<optional<ScoreIndex>> & GetFirstOccurrences() const
+    {
+        return firstOccurrences;
+    }
+
+private:
+    using State = uint32_t;
+    static constexpr State NoState = std::numeric_limits<State>::max();
+
+    vector<array<State, 10>> transitions;
+    // The state for the longest proper suffix of each state's scores.
+    vector<State> suffixLink;
+    // The nearest state along the suffix links at which a target ends.
+    vector<State> outputLink;
+    vector<vector<TargetIndex>> targetsEndingAt;
+    vector<optional<ScoreIndex>> firstOccurrences;
+    vector<ScoreIndex> targetLengths;
+    TargetIndex targetsRemaining;
+    State state;
+};
+
+} // namespace day14
+
+#endif // AOC_DAY14_HPP
@@ -0,0 +1,129 @@
+// Copyright (C) 2018 David Holmes <dholmes@dholmes.us>. All rights reserved.
+
+// Microbenchmark for the day14 recipe-making inner loop.  The original
+// push_back/modulo loop and the table-driven loop with a conditional subtract
+// both run on a byte-per-score vector reserved up front, so their difference
+// is down to the loop alone.  The packed Scoreboard kernel is timed too.
+
+#include "day14.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace day14;
+
+using std::vector;
+
+// The original implementation of the inner loop.
+void ReferenceAppendNewScores(vector<RecipeScore> & scores, RecipeScore elf1,
+                              RecipeScore elf2)
+{
+    auto sum = elf1 + elf2;
+    if (sum == 0) {
+        scores.push_back(0);
+        return;
+    }
+    if (sum >= 10) {
+        scores.push_back(1);
+    }
+    scores.push_back(sum % 10);
+}
+
+vector<RecipeScore> ReferenceRecipes(ScoreIndex count)
+{
+    vector<RecipeScore> scores = {3, 7};
+    scores.reserve(count + 2);
+    ScoreIndex elf1 = 0;
+    ScoreIndex elf2 = 1;
+    while (scores.size() < count) {
+        ReferenceAppendNewScores(scores, scores[elf1], scores[elf2]);
+        auto scoresSize = scores.size();
+        elf1 = ((elf1 + 1 + scores[elf1]) % scoresSize);
+        elf2 = ((elf2 + 1 + scores[elf2]) % scoresSize);
+    }
+    return scores;
+}
+
+// The table-driven loop on the same storage as ReferenceRecipes.  Both new
+// scores are always written, as Scoreboard does.
+vector<RecipeScore> TableRecipes(ScoreIndex count)
+{
+    vector<RecipeScore> scores(count + 2);
+    scores[0] = 3;
+    scores[1] = 7;
+    ScoreIndex size = 2;
+    ScoreIndex elf1 = 0;
+    ScoreIndex elf2 = 1;
+    while (size < count) {
+        const RecipeScore score1 = scores[elf1];
+        const RecipeScore score2 = scores[elf2];
+        const NewScores & newScores = newScoresTable[score1 + score2];
+        scores[size] = newScores.first;
+        scores[size + 1] = newScores.second;
+        size += newScores.count;
+        elf1 = AdvanceElf(elf1, score1, size);
+        elf2 = AdvanceElf(elf2, score2, size);
+    }
+    return scores;
+}
+
+Scoreboard KernelRecipes(ScoreIndex count)
+{
+    Scoreboard scores = {3, 7};
+    scores.Reserve(count + 2);
+    ScoreIndex elf1 = 0;
+    ScoreIndex elf2 = 1;
+    while (scores.Size() < count) {
+        MakeRecipes(scores, elf1, elf2);
+    }
+    return scores;
+}
+
+template <typename Function> double TimeSeconds(Function && function)
+{
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char ** argv)
+{
+    ScoreIndex count = 50000000;
+    if (argc > 1) {
+        std::from_chars(argv[1], argv[1] + std::strlen(argv[1]), count);
+    }
+
+    vector<RecipeScore> reference;
+    vector<RecipeScore> table;
+    Scoreboard kernel = {};
+    const double referenceSeconds =
+        TimeSeconds([&]() { reference = ReferenceRecipes(count); });
+    const double tableSeconds =
+        TimeSeconds([&]() { table = TableRecipes(count); });
+    const double kernelSeconds =
+        TimeSeconds([&]() { kernel = KernelRecipes(count); });
+
+    for (ScoreIndex i = 0; i < count; i++) {
+        if (reference[i] != table[i] || reference[i] != kernel[i]) {
+            std::cerr << "Mismatch at recipe " << i << '\n';
+            return 1;
+        }
+    }
+
+    std::cout << "Reference: " << referenceSeconds << " s ("
+              << (referenceSeconds * 1e9 / count) << " ns/recipe)\n";
+    std::cout << "Table:     " << tableSeconds << " s ("
+              << (tableSeconds * 1e9 / count) << " ns/recipe, "
+              << (referenceSeconds / tableSeconds) << "x)\n";
+    std::cout << "Packed:    " << kernelSeconds << " s ("
+              << (kernelSeconds * 1e9 / count) << " ns/recipe, "
+              << (referenceSeconds / kernelSeconds) << "x)\n";
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+// Copyright (C) 2018 David Holmes <dholmes@dholmes.us>. All rights reserved.
+
+#include "day14.hpp"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+
+using namespace day14;
+
+// Feeds a stream to the matcher, returning the number of scores before the
+// first match, if there is one.
+optional<ScoreIndex> FindWithScoreMatcher(const vector<RecipeScore> & target,
+                                          const vector<RecipeScore> & stream)
+{
+    ScoreMatcher matcher(target);
+    for (ScoreIndex i = 0; i < stream.size(); i++) {
+        if (matcher.Feed(stream[i])) {
+            return i + 1 - target.size();
+        }
+    }
+    return {};
+}
+
+vector<optional<ScoreIndex>>
+FindWithMultiScoreMatcher(const vector<vector<RecipeScore>> & targets,
+                          const vector<RecipeScore> & stream)
+{
+    MultiScoreMatcher matcher(targets);
+    for (ScoreIndex i = 0; i < stream.size() && !matcher.AllFound(); i++) {
+        matcher.Feed(stream[i], i);
+    }
+    return matcher.GetFirstOccurrences();
+}
+
+optional<ScoreIndex> FindWithSearch(const vector<RecipeScore> & target,
+                                    const vector<RecipeScore> & stream)
+{
+    const auto found =
+        std::search(stream.begin(), stream.end(), target.begin(), target.end());
+    if (found == stream.end()) {
+        return {};
+    }
+    return found - stream.begin();
+}
+
+vector<RecipeScore> MakeScores(ScoreIndex count)
+{
+    Scoreboard scores = {3, 7};
+    ScoreIndex elf1 = 0;
+    ScoreIndex elf2 = 1;
+    while (scores.Size() < count) {
+        MakeRecipes(scores, elf1, elf2);
+    }
+    vector<RecipeScore> out;
+    for (ScoreIndex i = 0; i < count; i++) {
+        out.push_back(scores[i]);
+    }
+    return out;
+}
+
+TEST(ScoreboardTest, Example)
+{
+    const vector<RecipeScore> expected = {3, 7, 1, 0, 1, 0, 1, 2, 4, 5,
+                                          1, 5, 8, 9, 1, 6, 7, 7, 9, 2};
+    ASSERT_EQ(expected, MakeScores(expected.size()));
+}
+
+TEST(ScoreMatcherTest, Examples)
+{
+    const vector<RecipeScore> scores = MakeScores(2100);
+    ASSERT_EQ(9u, *FindWithScoreMatcher({5, 1, 5, 8, 9}, scores));
+    ASSERT_EQ(5u, *FindWithScoreMatcher({0, 1, 2, 4, 5}, scores));
+    ASSERT_EQ(18u, *FindWithScoreMatcher({9, 2, 5, 1, 0}, scores));
+    ASSERT_EQ(2018u, *FindWithScoreMatcher({5, 9, 4, 1, 4}, scores));
+}
+
+TEST(ScoreMatcherTest, FallsBackOnPartialMatches)
+{
+    ASSERT_EQ(1u, *FindWithScoreMatcher({1, 1, 2}, {1, 1, 1, 2}));
+    ASSERT_EQ(2u, *FindWithScoreMatcher({1, 2, 1, 2, 3},
+                                        {1, 2, 1, 2, 1, 2, 3}));
+    ASSERT_FALSE(FindWithScoreMatcher({1, 2, 3}, {1, 2, 1, 3}));
+}
+
+TEST(MultiScoreMatcherTest, Examples)
+{
+    const vector<optional<ScoreIndex>> expected = {9, 5, 18, 2018};
+    ASSERT_EQ(expected, FindWithMultiScoreMatcher({{5, 1, 5, 8, 9},
+                                                   {0, 1, 2, 4, 5},
+                                                   {9, 2, 5, 1, 0},
+                                                   {5, 9, 4, 1, 4}},
+                                                  MakeScores(2100)));
+}
+
+TEST(MultiScoreMatcherTest, DuplicateTargets)
+{
+    const vector<optional<ScoreIndex>> expected = {1, 0, 1};
+    ASSERT_EQ(expected,
+              FindWithMultiScoreMatcher({{2, 3}, {1, 2}, {2, 3}}, {1, 2, 3}));
+}
+
+TEST(MultiScoreMatcherTest, TargetsWhichArePrefixesOfOthers)
+{
+    const vector<optional<ScoreIndex>> expected = {1, 1, 1};
+    ASSERT_EQ(expected, FindWithMultiScoreMatcher({{1}, {1, 2}, {1, 2, 3}},
+                                                  {0, 1, 2, 3}));
+}
+
+TEST(MultiScoreMatcherTest, TargetsFoundThroughSuffixLinks)
+{
+    // {2} and {2, 3} end inside the longer, unfinished {1, 2, 3, 4}, and
+    // {2, 3, 5} needs the suffix link from {1, 2, 3}.
+    const vector<optional<ScoreIndex>> expected = {{}, 1, 1, 1};
+    ASSERT_EQ(expected,
+              FindWithMultiScoreMatcher({{1, 2, 3, 4}, {2}, {2, 3}, {2, 3, 5}},
+                                        {1, 2, 3, 5}));
+}
+
+TEST(MultiScoreMatcherTest, MatchesSearchOnRandomTargets)
+{
+    std::mt19937 random(14);
+    // A small alphabet makes overlapping and repeated targets common.
+    std::uniform_int_distribution<int> score(0, 2);
+    std::uniform_int_distribution<int> length(1, 6);
+    std::uniform_int_distribution<int> count(1, 8);
+    for (int round = 0; round < 300; round++) {
+        vector<RecipeScore> stream(200);
+        for (auto & s : stream) {
+            s = score(random);
+        }
+        vector<vector<RecipeScore>> targets(count(random));
+        for (auto & target : targets) {
+            target.resize(length(random));
+            for (auto & s : target) {
+                s = score(random);
+            }
+        }
+
+        const auto found = FindWithMultiScoreMatcher(targets, stream);
+        for (std::size_t t = 0; t < targets.size(); t++) {
+            ASSERT_EQ(FindWithSearch(targets[t], stream), found[t]);
+            ASSERT_EQ(FindWithSearch(targets[t], stream),
+                      FindWithScoreMatcher(targets[t], stream));
+        }
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
@@ -8,8 +8,8 @@
 #include <unistd.h> // For STDIN_FILENO
 
 #include <array>
-#include <bitset>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <fstream>
 #include <limits>
@@ -39,57 +39,110 @@ ansi::cursor_position GetCursor()
     return *maybeCursor;
 }
 
-void CheckUsage(int argc, char ** argv)
+struct Options
 {
-    if (argc != 2) {
-        std::cerr << "USAGE: " << argv << " inputFileName.txt\n";
+    string inputFileName;
+    // Run at full speed without using the terminal, printing round timings.
+    bool headless = false;
+    // Find the lowest attack power with which the elves win without losses.
+    bool findElfAttackPower = false;
+    // In headless mode, also write a binary log of the battle's events here.
+    string eventLogFileName;
+};
+
+Options ParseOptions(int argc, char ** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        string_view arg = argv[i];
+        if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--find-elf-attack-power") {
+            options.findElfAttackPower = true;
+        } else if (arg == "--event-log" && i + 1 < argc) {
+            options.eventLogFileName = argv[++i];
+        } else if (options.inputFileName.empty() && !arg.empty() &&
+                   arg[0] != '-') {
+            options.inputFileName = arg;
+        } else {
+            options.inputFileName.clear();
+            break;
+        }
+    }
+    if (!options.eventLogFileName.empty() &&
+        (!options.headless || options.findElfAttackPower)) {
+        std::cerr << "--event-log needs --headless, and can't be used with"
+                     " --find-elf-attack-power\n";
+        std::exit(1);
+    }
+    if (options.inputFileName.empty()) {
+        std::cerr << "USAGE: " << argv[0]
+                  << " [--headless [--event-log file.bin]]"
+                     " [--find-elf-attack-power] inputFileName.txt\n";
         std::exit(1);
     }
+    return options;
 }
 
-pair<Map, State> ReadInput(int argc, char ** argv)
+pair<Map, State> ReadInput(const Options & options)
 {
-    CheckUsage(argc, argv);
-    std::ifstream input(argv[1]);
+    std::ifstream input(options.inputFileName);
     return ReadInput(input);
 }
 
 void DrawMap(std::ostream & stream, ansi::cursor_position pos, const Map & map)
 {
     stream << ansi::cup(pos);
-    for (Row y = 0; y < MapSize; y++) {
-        for (Column x = 0; x < MapSize; x++) {
-            stream << (map[y][x] ? '.' : '#');
+    for (Row y = 0; y < map.GetHeight(); y++) {
+        for (Column x = 0; x < map.GetWidth(); x++) {
+            stream << (map.IsOpen({x, y}) ? '.' : '#');
         }
         stream << '\n';
     }
 }
 
+// Display-only information about what's happening in the battle.
+struct DisplayStatus
+{
+    explicit DisplayStatus(const State & state)
+        : statuses(state.EntityIdEnd())
+    {
+    }
+
+    EntityId activeEntity = NoEntity;
+    EntityId targetEntity = NoEntity;
+    Path currentPath;
+    vector<string> statuses;
+};
+
 void DrawEntities(std::ostream & stream, ansi::cursor_position areaPos,
-                  const State & state)
+                  const State & state, const DisplayStatus & status)
 {
-    for (const auto [coords, id] : state.entitiesByLocation) {
-        const auto & entity = state.entities.at(id);
+    for (EntityId id = 1; id < state.EntityIdEnd(); id++) {
+        if (!state.IsAlive(id)) {
+            continue;
+        }
+        const Coordinates coords = state.coords[id];
         char c = ' ';
         graphic::color3 color = graphic::color3::white;
-        if (entity.type == EntityType::Elf) {
+        if (state.types[id] == EntityType::Elf) {
             color = graphic::color3::green;
             c = 'E';
         } else {
             color = graphic::color3::red;
             c = 'G';
         }
-        if (state.activeEntity == id) {
+        if (status.activeEntity == id) {
             stream << graphic::bold();
             // Draw path.
-            for (auto pathCoords : entity.currentPath) {
+            for (auto pathCoords : status.currentPath) {
                 ansi::cursor_position pathCoordPos = areaPos;
                 pathCoordPos.x += pathCoords.x;
                 pathCoordPos.y += pathCoords.y;
                 stream << ansi::cup(pathCoordPos) << '*';
             }
         }
-        if (state.targetEntity == id) {
+        if (status.targetEntity == id) {
             stream << graphic::reverse_video();
         }
         ansi::cursor_position entityPos = areaPos;
@@ -108,7 +161,7 @@ struct DisplayRectangle
 
 class Display
 {
-    friend Display CreateDisplay(std::istream &, std::ostream &, int);
+    friend Display CreateDisplay(std::istream &, std::ostream &, const Map &);
 
 public:
     Display(std::istream & in, std::ostream & out) : in(in), out(out) {}
@@ -119,20 +172,22 @@ public:
     DisplayRectangle stats;
 };
 
-Display CreateDisplay(std::istream & in, std::ostream & out, int rows)
+Display CreateDisplay(std::istream & in, std::ostream & out, const Map & map)
 {
+    const auto width = static_cast<ansi::term_col>(map.GetWidth());
+    const auto height = static_cast<ansi::term_row>(map.GetHeight());
+    const int rows = height + 2;
     Display disp(in, out);
     for (int i = 0; i < rows; i++) {
         out << '\n';
     }
     out << cursor(cursor::direction::up, rows) << std::flush;
     cursor_position cursor = GetCursor();
-    cursor_position dimensions = {MapSize + 40, MapSize + 1};
+    cursor_position dimensions(width + 40, height + 1);
     disp.screen = {cursor, dimensions};
-    disp.map = {cursor + cursor_position(0, 1),
-                cursor_position(MapSize, MapSize)};
-    disp.stats = {cursor + cursor_position(MapSize, 0),
-                  cursor_position(40, MapSize + 1)};
+    disp.map = {cursor + cursor_position(0, 1), cursor_position(width, height)};
+    disp.stats = {cursor + cursor_position(width, 0),
+                  cursor_position(40, height + 1)};
     return disp;
 }
 
@@ -143,157 +198,225 @@ void DrawText(std::ostream & stream, ansi::cursor_position pos,
 }
 
 void DrawAllEntityStats(std::ostream & stream, cursor_position pos,
-                        const State & state)
+                        const State & state, const DisplayStatus & status)
 {
     using std::setw;
     cursor_position rowStart = pos;
-    for (auto [id, entity] : state.entities) {
+    for (EntityId id = 1; id < state.EntityIdEnd(); id++) {
         stream << ansi::cup(rowStart);
         rowStart += {0, 1};
-        if (id == state.activeEntity) {
+        if (id == status.activeEntity) {
             stream << graphic::bold() << graphic::underline();
         }
-        if (entity.hp <= 0) {
+        if (!state.IsAlive(id)) {
             stream << graphic::crossed_out();
         }
-        stream << setw(2) << id << setw(8) << entity.type << setw(4)
-               << entity.hp << ' ' << entity.status << graphic::reset();
+        stream << setw(2) << id << setw(8) << state.types[id] << setw(4)
+               << state.hitPoints[id] << ' ' << status.statuses[id]
+               << graphic::reset();
     }
 }
 
-void DrawEverything(const Map & map, State & state, Display & disp)
+void DrawEverything(const Map & map, const State & state,
+                    const DisplayStatus & status, Display & disp)
 {
     std::stringstream ss;
     ss << "Round: " << state.round;
     DrawMap(std::cout, disp.map.topLeft, map);
     DrawText(std::cout, disp.screen.topLeft, ss.str());
-    DrawEntities(std::cout, disp.map.topLeft, state);
-    DrawAllEntityStats(std::cout, disp.stats.topLeft, state);
+    DrawEntities(std::cout, disp.map.topLeft, state, status);
+    DrawAllEntityStats(std::cout, disp.stats.topLeft, state, status);
     std::cout << std::flush;
 }
 
-int CountEntityHitPoints(const State & state, EntityType type)
+// Draws the battle after every move and action, keeping track of the
+// display-only status of each entity.
+class DisplayObserver
 {
-    int out = 0;
-    for (auto & [id, entity] : state.entities) {
-        if (entity.type == type) {
-            out += entity.hp;
+public:
+    DisplayObserver(const Map & map, const State & state, Display & disp)
+        : map(map), disp(disp), status(state)
+    {
+    }
+
+    void BeforeMove(const State & state, EntityId id)
+    {
+        status.activeEntity = id;
+        const auto path = SearchForTarget(map, state, state.coords[id],
+                                          EnemyType(state.types[id]));
+        status.currentPath = path ? *path : Path();
+        DrawEverything(map, state, status, disp);
+        std::this_thread::sleep_for(20ms);
+        status.currentPath.clear();
+        status.statuses[id] = "Moving";
+    }
+    void AfterAttack(const State & state, EntityId attacker, EntityId target)
+    {
+        status.statuses[attacker] = "Attacking";
+        status.statuses[target] =
+            state.IsAlive(target) ? "Under Attack" : "Dead";
+        status.targetEntity = target;
+    }
+    void AfterAction(const State & state, EntityId id)
+    {
+        status.activeEntity = id;
+        if (status.statuses[id].empty()) {
+            status.statuses[id] = "Not Moving";
         }
+        DrawEverything(map, state, status, disp);
+        std::this_thread::sleep_for(20ms);
+        status.statuses[id].clear();
+        status.targetEntity = NoEntity;
     }
-    return out;
-}
+    void AfterRound(const State & state)
+    {
+        status.activeEntity = NoEntity;
+        DrawEverything(map, state, status, disp);
+    }
+
+private:
+    const Map & map;
+    Display & disp;
+    DisplayStatus status;
+};
 
-void TakeTurns(const Map & map, State & state, Display & disp)
+// Records how long each round takes.
+class TimingObserver
 {
-    const auto beginningOfTurnLocations = state.entitiesByLocation;
-    vector<EntityId> turnOrder;
-    for (auto & [coord, id] : beginningOfTurnLocations) {
-        turnOrder.push_back(id);
-    }
+public:
+    using Clock = std::chrono::steady_clock;
 
-    for (auto id : turnOrder) {
-        
-        state.activeEntity = id;
-        auto & entity = state.entities.at(id);
-        if (entity.hp <= 0) {
-            continue;
-        }
+    TimingObserver() : roundStart(Clock::now()) {}
 
-        auto coord = entity.coords;
+    void BeforeMove(const State & /*state*/, EntityId /*id*/) {}
+    void AfterAttack(const State & /*state*/, EntityId /*attacker*/,
+                     EntityId /*target*/)
+    {
+    }
+    void AfterAction(const State & /*state*/, EntityId /*id*/) {}
+    void AfterRound(const State & /*state*/)
+    {
+        const auto now = Clock::now();
+        roundTimes.push_back(now - roundStart);
+        roundStart = now;
+    }
 
-        set<Coordinates> targets = GetTargets(state, EnemyType(entity.type));
+    const vector<std::chrono::duration<double>> & GetRoundTimes() const
+    {
+        return roundTimes;
+    }
 
-        auto attackThisTarget = SelectAdjacentTarget(state, coord, targets);
+private:
+    Clock::time_point roundStart;
+    vector<std::chrono::duration<double>> roundTimes;
+};
 
-        if (!attackThisTarget) {
+// Passes every notification on to two observers.
+template <typename First, typename Second>
+class ObserverPair
+{
+public:
+    ObserverPair(First & first, Second & second) : first(first), second(second)
+    {
+    }
 
-            // Search for the nearest target.
-            auto maybePath = SearchForTarget(map, state, coord, targets);
-            if (!maybePath) {
-                // Don't move this turn.
-                entity.status = "Not Moving";
-            } else {
-                entity.currentPath = *maybePath;
+    void BeforeMove(const State & state, EntityId id)
+    {
+        first.BeforeMove(state, id);
+        second.BeforeMove(state, id);
+    }
+    void AfterAttack(const State & state, EntityId attacker, EntityId target)
+    {
+        first.AfterAttack(state, attacker, target);
+        second.AfterAttack(state, attacker, target);
+    }
+    void AfterAction(const State & state, EntityId id)
+    {
+        first.AfterAction(state, id);
+        second.AfterAction(state, id);
+    }
+    void AfterRound(const State & state)
+    {
+        first.AfterRound(state);
+        second.AfterRound(state);
+    }
 
-                DrawEverything(map, state, disp);
-                std::this_thread::sleep_for(20ms);
+private:
+    First & first;
+    Second & second;
+};
 
-                auto move = maybePath->at(0);
-                // Move to an adjacent tile.
-                entity.coords = move;
-                state.entitiesByLocation.erase(coord);
-                state.entitiesByLocation.insert({move, id});
-                entity.status = "Moving";
+void PrintOutcome(std::ostream & stream, const BattleOutcome & outcome)
+{
+    stream << (outcome.winner == EntityType::Elf ? "Elves" : "Goblins")
+           << " win! Round=" << outcome.fullRounds
+           << ", HP=" << outcome.remainingHp << ", Outcome=" << outcome.Score()
+           << '\n';
+}
 
-                attackThisTarget =
-                    SelectAdjacentTarget(state, entity.coords, targets);
-            }
+int main(int argc, char ** argv)
+{
+    const Options options = ParseOptions(argc, argv);
+    auto [map, state] = ReadInput(options);
+
+    if (options.findElfAttackPower) {
+        const auto result = FindElfAttackPower(map, state);
+        if (!result) {
+            std::cout << "The elves can't win without losses.\n";
+            return 0;
         }
+        std::cout << "Elf attack power: " << result->attackPower << '\n';
+        PrintOutcome(std::cout, result->outcome);
+        return 0;
+    }
 
-        if (attackThisTarget) {
-            // Attach the target.
-            entity.status = "Attacking";
-            auto & enemy = state.entities.at(*attackThisTarget);
-            state.targetEntity = enemy.id;
-            enemy.status = "Under Attack";
-            enemy.hp -= entity.attackPower;
-            if (enemy.hp <= 0) {
-                enemy.hp = 0;
-                enemy.status = "Dead";
-                state.entitiesByLocation.erase(enemy.coords);
+    if (options.headless) {
+        BfsEngine bfs;
+        TimingObserver observer;
+        BattleOutcome outcome;
+        if (options.eventLogFileName.empty()) {
+            outcome = RunBattle(map, state, bfs, {}, observer);
+        } else {
+            BattleRecorder recorder(state);
+            ObserverPair<TimingObserver, BattleRecorder> observers(observer,
+                                                                   recorder);
+            outcome = RunBattle(map, state, bfs, {}, observers);
+
+            std::ofstream log(options.eventLogFileName, std::ios::binary);
+            WriteEvents(log, recorder.GetEvents());
+            if (!log) {
+                std::cerr << "Could not write " << options.eventLogFileName
+                          << '\n';
+                std::exit(1);
             }
         }
-        entity.currentPath = {};
 
-        DrawEverything(map, state, disp);
-        std::this_thread::sleep_for(20ms);
-        entity.status = "";
-        state.targetEntity = 0;
-    }
-    state.activeEntity = 0;
-
-    int elfHp = CountEntityHitPoints(state, EntityType::Elf);
-    int goblinHp = CountEntityHitPoints(state, EntityType::Goblin);
-    if (elfHp == 0 || goblinHp == 0) {
-        return;
-    } else {
-        state.round++;
+        std::chrono::duration<double> total{0};
+        for (std::size_t i = 0; i < observer.GetRoundTimes().size(); i++) {
+            const auto elapsed = observer.GetRoundTimes()[i];
+            const bool complete = i < outcome.fullRounds;
+            std::cout << "Round " << (i + 1) << ": " << (elapsed.count() * 1000)
+                      << " ms" << (complete ? "" : " (incomplete)") << '\n';
+            total += elapsed;
+        }
+        const auto rounds = observer.GetRoundTimes().size();
+        std::cout << "Simulated " << rounds << " rounds in " << total.count()
+                  << " s (" << (rounds / total.count()) << " rounds/s).\n";
+        PrintOutcome(std::cout, outcome);
+        return 0;
     }
-}
 
-int main(int argc, char ** argv)
-{
-    auto [map, state] = ReadInput(argc, argv);
-
-    Display disp = CreateDisplay(std::cin, std::cout, map.size() + 2);
+    Display disp = CreateDisplay(std::cin, std::cout, map);
     cursor_position displayEnd =
         disp.screen.topLeft + cursor_position(0, disp.screen.dimensions.y);
 
     DrawMap(std::cout, disp.map.topLeft, map);
 
-    bool done = false;
-    while (!done) {
-        TakeTurns(map, state, disp);
-
-        DrawEverything(map, state, disp);
-        // std::this_thread::sleep_for(200ms);
-
-        int elfHp = CountEntityHitPoints(state, EntityType::Elf);
-        int goblinHp = CountEntityHitPoints(state, EntityType::Goblin);
-        int lastFullRound = state.round-1;
-        if (elfHp == 0) {
-            done = true;
-            std::cout << "Goblins win! Round=" << lastFullRound
-                      << ", HP=" << goblinHp
-                      << ", Outcome=" << (lastFullRound * goblinHp) << '\n';
-        } else if (goblinHp == 0) {
-            done = true;
-            std::cout << "Elves win! Round=" << lastFullRound
-                      << ", HP=" << elfHp
-                      << ", Outcome=" << (lastFullRound * elfHp) << '\n';
-        }
-    }
+    BfsEngine bfs;
+    DisplayObserver observer(map, state, disp);
+    const BattleOutcome outcome = RunBattle(map, state, bfs, {}, observer);
     std::cout << ansi::cup(displayEnd) << '\n';
+    PrintOutcome(std::cout, outcome);
 
     return 0;
 }
@@ -3,36 +3,32 @@
 #ifndef AOC_DAY15_HPP
 #define AOC_DAY15_HPP
 
+#include <algorithm>
 #include <array>
-#include <bitset>
+#include <atomic>
 #include <cstdint>
-#include <deque>
 #include <iomanip>
 #include <iostream>
-#include <map>
+#include <limits>
+#include <mutex>
 #include <optional>
-#include <set>
+#include <thread>
 #include <vector>
 
 namespace day15 {
 
-const auto MapSize = 32;
-
 using std::array;
-using std::bitset;
-using std::deque;
 using std::optional;
 using std::pair;
-using std::set;
 using std::string;
 using std::string_view;
 using std::vector;
 
 using std::int32_t;
 using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
 
-using MapRow = bitset<MapSize>;
-using Map = array<MapRow, MapSize>;
 using Column = int32_t;
 using Row = int32_t;
 using EntityId = uint32_t;
@@ -42,17 +38,6 @@ using AttackPower = uint32_t;
 using Distance = uint32_t;
 
 
-template <typename Key, typename Value>
-bool Contains(const std::map<Key, Value> & m, Key key)
-{
-    return m.find(key) != m.end();
-}
-
-template <typename Key> bool Contains(const set<Key> & s, Key key)
-{
-    return s.find(key) != s.end();
-}
-
 struct Coordinates
 {
     Coordinates(Column x, Row y) : x(x), y(y) {}
@@ -94,6 +79,72 @@ struct Coordinates
 
 using Path = vector<Coordinates>;
 
+// The layout of a cave stored as a flat row-major array with a one-cell wall
+// around it, so the neighbors of any square in the cave are found by adding a
+// fixed offset and never need bounds checks.  Cell indexes increase in "reading
+// order".
+struct Grid
+{
+    Column width = 0;
+    Row height = 0;
+
+    int32_t Stride() const { return width + 2; }
+    int32_t CellCount() const { return Stride() * (height + 2); }
+
+    int32_t IndexOf(Coordinates coords) const
+    {
+        return (coords.y + 1) * Stride() + (coords.x + 1);
+    }
+    Coordinates CoordinatesOf(int32_t index) const
+    {
+        return {index % Stride() - 1, index / Stride() - 1};
+    }
+
+    // Offsets to the adjacent cells, in "reading order".
+    array<int32_t, 4> NeighborOffsets() const
+    {
+        return {-Stride(), -1, 1, Stride()};
+    }
+
+    bool operator==(const Grid & other) const
+    {
+        return std::tie(width, height) == std::tie(other.width, other.height);
+    }
+    bool operator!=(const Grid & other) const { return !(*this == other); }
+};
+
+// Which squares of the cave are open (not walls).  Squares outside the cave
+// are walls.
+class Map
+{
+public:
+    Map() = default;
+    Map(Column width, Row height)
+        : grid{width, height}, open(grid.CellCount(), 0)
+    {
+    }
+
+    const Grid & GetGrid() const { return grid; }
+    Column GetWidth() const { return grid.width; }
+    Row GetHeight() const { return grid.height; }
+
+    bool IsOpen(Coordinates coords) const
+    {
+        return open[grid.IndexOf(coords)];
+    }
+    void SetOpen(Coordinates coords, bool val)
+    {
+        open[grid.IndexOf(coords)] = val;
+    }
+
+    // One byte per cell of the grid, including the wall around the cave.
+    const vector<uint8_t> & GetCells() const { return open; }
+
+private:
+    Grid grid;
+    vector<uint8_t> open;
+};
+
 enum class EntityType
 {
     Elf,
@@ -116,273 +167,933 @@ EntityType EnemyType(EntityType type)
     }
 }
 
-struct Entity
+const HitPoints StartingHitPoints = 200;
+const AttackPower DefaultAttackPower = 3;
+
+// Entity IDs start at 1, so 0 can mean "no entity".
+const EntityId NoEntity = 0;
+
+// A number which no other state, and no earlier version of the same state, has
+// had.  It is renewed whenever the state changes and whenever it is copied, so
+// anything cached from a state can tell if it still applies.
+class StateGeneration
 {
-    Entity(EntityId id, EntityType type, Coordinates coords)
-        : id(id), type(type), coords(coords), hp(200), attackPower(3),
-          status(){};
-    EntityId id;
-    EntityType type;
-    Coordinates coords;
-    HitPoints hp;
-    AttackPower attackPower;
-    string status;
-    Path currentPath;
+public:
+    StateGeneration() : value(Next()) {}
+    StateGeneration(const StateGeneration & /*other*/) : value(Next()) {}
+    StateGeneration & operator=(const StateGeneration & /*other*/)
+    {
+        value = Next();
+        return *this;
+    }
+
+    void Advance() { value = Next(); }
+    uint64_t Get() const { return value; }
+
+private:
+    static uint64_t Next()
+    {
+        static std::atomic<uint64_t> counter{0};
+        return ++counter;
+    }
+
+    uint64_t value;
 };
 
+// The state of a battle.  Entities are stored as a structure of arrays indexed
+// by EntityId, and a dense grid (laid out like the map's) records which entity
+// stands on each square.
 struct State
 {
+    State() = default;
+    explicit State(const Grid & grid)
+        : grid(grid), entityAt(grid.CellCount(), NoEntity),
+          inRangeOf{vector<uint8_t>(grid.CellCount(), 0),
+                    vector<uint8_t>(grid.CellCount(), 0)}
+    {
+        // Entry 0 is a placeholder for NoEntity.
+        types.push_back(EntityType::Elf);
+        coords.push_back({0, 0});
+        hitPoints.push_back(0);
+        attackPowers.push_back(0);
+    }
+
+    EntityId AddEntity(EntityType type, Coordinates at)
+    {
+        const EntityId id = types.size();
+        types.push_back(type);
+        coords.push_back(at);
+        hitPoints.push_back(StartingHitPoints);
+        attackPowers.push_back(DefaultAttackPower);
+        entityAt[grid.IndexOf(at)] = id;
+        livingCounts[static_cast<int>(type)]++;
+        UpdateInRange(type, at, 1);
+        return id;
+    }
+
+    // One past the highest EntityId.
+    EntityId EntityIdEnd() const { return types.size(); }
+
+    bool IsAlive(EntityId id) const { return hitPoints[id] > 0; }
+
+    EntityId GetEntityAt(Coordinates at) const
+    {
+        return entityAt[grid.IndexOf(at)];
+    }
+
+    uint32_t CountLiving(EntityType type) const
+    {
+        return livingCounts[static_cast<int>(type)];
+    }
+
+    // Returns true if the cell with the given index is next to a living entity
+    // of the given type.
+    bool IsInRangeOf(EntityType type, int32_t index) const
+    {
+        return inRangeOf[static_cast<int>(type)][index] != 0;
+    }
+
+    void Move(EntityId id, Coordinates to)
+    {
+        UpdateInRange(types[id], coords[id], -1);
+        entityAt[grid.IndexOf(coords[id])] = NoEntity;
+        entityAt[grid.IndexOf(to)] = id;
+        coords[id] = to;
+        UpdateInRange(types[id], to, 1);
+        generation.Advance();
+    }
+
+    // Applies an attack, returning true if it killed the entity.
+    bool Damage(EntityId id, AttackPower damage)
+    {
+        hitPoints[id] -= damage;
+        if (hitPoints[id] > 0) {
+            return false;
+        }
+        hitPoints[id] = 0;
+        entityAt[grid.IndexOf(coords[id])] = NoEntity;
+        livingCounts[static_cast<int>(types[id])]--;
+        UpdateInRange(types[id], coords[id], -1);
+        generation.Advance();
+        return true;
+    }
+
     Round round = 1;
-    EntityId activeEntity = 0;
-    EntityId targetEntity = 0;
-    std::map<EntityId, Entity> entities;
-    std::map<Coordinates, EntityId> entitiesByLocation;
+
+    vector<EntityType> types;
+    vector<Coordinates> coords;
+    vector<HitPoints> hitPoints;
+    vector<AttackPower> attackPowers;
+
+    Grid grid;
+    vector<EntityId> entityAt;
+    array<uint32_t, 2> livingCounts = {0, 0};
+    // For each faction, how many of its living entities are next to each
+    // cell.  Kept up to date as entities move and die.
+    array<vector<uint8_t>, 2> inRangeOf;
+    // Renewed by every move and death, so cached searches can tell they're
+    // stale.
+    StateGeneration generation;
+
+    // The order in which entities take their turns this round.  Kept here so
+    // its storage is reused from round to round.
+    vector<EntityId> turnOrder;
+
+private:
+    void UpdateInRange(EntityType type, Coordinates at, int delta)
+    {
+        auto & counts = inRangeOf[static_cast<int>(type)];
+        const int32_t index = grid.IndexOf(at);
+        for (int32_t offset : grid.NeighborOffsets()) {
+            counts[index + offset] += delta;
+        }
+    }
 };
 
 pair<Map, State> ReadInput(std::istream & stream)
 {
-    Map map;
-    State state;
-    EntityId nextEntityId = 1;
+    vector<string> lines;
     string line;
-    Row y = 0;
     while (std::getline(stream, line)) {
-        if (y > MapSize) {
-            std::cerr << "Input file is too long (max = " << MapSize
-                      << " lines).\n";
-        }
-        Column lineSize = line.size();
-        if (line.size() > MapSize) {
-            std::cerr << "Input line " << y << " is too long (max = " << MapSize
-                      << " characters).\n";
-            std::exit(1);
-        }
+        lines.push_back(line);
+    }
 
+    Column width = 0;
+    for (const auto & l : lines) {
+        width = std::max(width, static_cast<Column>(l.size()));
+    }
+    const Row height = lines.size();
+
+    Map map(width, height);
+    State state(map.GetGrid());
+    for (Row y = 0; y < height; y++) {
+        const Column lineSize = lines[y].size();
         for (Column x = 0; x < lineSize; x++) {
-            if (line[x] != '#') {
-                map[y][x] = true;
-                if (line[x] == 'G') {
-                    const auto id = nextEntityId++;
-                    const Coordinates coords = {x, y};
-                    state.entities.emplace(
-                        id, Entity(id, EntityType::Goblin, coords));
-                    state.entitiesByLocation.emplace(coords, id);
-                } else if (line[x] == 'E') {
-                    const auto id = nextEntityId++;
-                    const Coordinates coords = {x, y};
-                    state.entities.emplace(id,
-                                           Entity(id, EntityType::Elf, coords));
-                    state.entitiesByLocation.emplace(coords, id);
+            const char c = lines[y][x];
+            if (c != '#') {
+                map.SetOpen({x, y}, true);
+                if (c == 'G') {
+                    state.AddEntity(EntityType::Goblin, {x, y});
+                } else if (c == 'E') {
+                    state.AddEntity(EntityType::Elf, {x, y});
                 }
             }
         }
-
-        y++;
     }
 
-    return {map, state};
+    return {std::move(map), std::move(state)};
 }
 
-// Returns adjacent squares in "reading order";
-vector<Coordinates> GetAdjacentSquares(Coordinates coords)
+// Returns adjacent squares in "reading order".
+array<Coordinates, 4> GetAdjacentSquares(Coordinates coords)
 {
-    vector<Coordinates> out;
-
     const Coordinates north = {0, -1};
     const Coordinates west = {-1, 0};
     const Coordinates east = {1, 0};
     const Coordinates south = {0, 1};
 
-    const array<Coordinates, 4> neighbors = {north, west, east, south};
-    for (auto neighbor : neighbors) {
-        out.push_back(neighbor + coords);
-    }
-
-    return out;
-};
+    return {{coords + north, coords + west, coords + east, coords + south}};
+}
 
 optional<EntityId> SelectAdjacentTarget(const State & state, Coordinates source,
-                                        const set<Coordinates> & targets)
+                                        EntityType targetType)
 {
     optional<EntityId> attackThisTarget = {};
+    if (!state.IsInRangeOf(targetType, state.grid.IndexOf(source))) {
+        return attackThisTarget;
+    }
     HitPoints lowestHp = std::numeric_limits<HitPoints>::max();
     for (auto neighbor : GetAdjacentSquares(source)) {
-        if (Contains(targets, neighbor)) {
-            const EntityId enemyId = state.entitiesByLocation.at(neighbor);
-            const Entity & enemy = state.entities.at(enemyId);
-            if (enemy.hp < lowestHp) {
-                lowestHp = enemy.hp;
-                attackThisTarget = enemyId;
-            }
+        const EntityId enemyId = state.GetEntityAt(neighbor);
+        if (enemyId != NoEntity && state.types[enemyId] == targetType &&
+            state.hitPoints[enemyId] < lowestHp) {
+            lowestHp = state.hitPoints[enemyId];
+            attackThisTarget = enemyId;
         }
     }
     return attackThisTarget;
 }
 
-vector<Coordinates> GetAdjacentOpenSquares(const Map & map, const State & state,
-                                           Coordinates coords)
+const Distance Unreachable = std::numeric_limits<Distance>::max();
+
+// Distances from every open, unoccupied square to the nearest square in range
+// of an entity of the target type, found by one breadth-first search from all
+// of those squares at once.  Each square is also labelled with the first, in
+// "reading order", of the nearest squares in range.
+//
+// Every entity hunting the target type can then find its step by looking at
+// its neighbors alone, instead of searching from scratch: the nearest square
+// in range is the smallest label among the neighbors at the smallest distance,
+// and the step is the first neighbor with that distance and label.  The field
+// only depends on which squares are occupied and which are in range, so it
+// stays valid until an entity moves or dies.
+class DistanceField
 {
-    vector<Coordinates> out;
+public:
+    // Returns true if the field was built from this state, and nothing has
+    // moved or died since.
+    bool IsCurrent(const State & state) const
+    {
+        return builtAt == state.generation.Get();
+    }
 
-    for (Coordinates neighbor : GetAdjacentSquares(coords)) {
-        auto [x, y] = neighbor;
-        if (!map[y][x]) {
-            continue;
+    // A field costs a search of the whole map, so it's only worth building
+    // if it will be shared.  Returns true if this has already been asked
+    // since anything last moved or died.
+    bool IsWorthBuilding(const State & state)
+    {
+        const bool shared = askedAt == state.generation.Get();
+        askedAt = state.generation.Get();
+        return shared;
+    }
+
+    void Build(const Map & map, const State & state, EntityType targetType)
+    {
+        const Grid & grid = map.GetGrid();
+        distances.assign(grid.CellCount(), Unreachable);
+        labels.resize(grid.CellCount());
+        queue.resize(grid.CellCount());
+        neighborOffsets = grid.NeighborOffsets();
+        builtAt = state.generation.Get();
+
+        const auto & cells = map.GetCells();
+        const auto & entityAt = state.entityAt;
+        const auto isFree = [&](int32_t i) {
+            return cells[i] && entityAt[i] == NoEntity;
+        };
+
+        // Seeding in index order makes each source the first at distance 0.
+        int32_t head = 0;
+        int32_t tail = 0;
+        for (int32_t i = 0; i < grid.CellCount(); i++) {
+            if (isFree(i) && state.IsInRangeOf(targetType, i)) {
+                distances[i] = 0;
+                labels[i] = i;
+                queue[tail++] = i;
+            }
         }
-        if (!Contains(state.entitiesByLocation, neighbor)) {
-            out.push_back(neighbor);
+        while (head != tail) {
+            const int32_t u = queue[head++];
+            for (int32_t offset : neighborOffsets) {
+                const int32_t v = u + offset;
+                if (!isFree(v)) {
+                    continue;
+                }
+                if (distances[v] == Unreachable) {
+                    distances[v] = distances[u] + 1;
+                    labels[v] = labels[u];
+                    queue[tail++] = v;
+                } else if (distances[v] == distances[u] + 1 &&
+                           labels[u] < labels[v]) {
+                    labels[v] = labels[u];
+                }
+            }
         }
     }
 
-    return out;
-}
+    // Returns the cell index of the square the entity on the given cell
+    // should step onto, or {} if no square in range can be reached.
+    optional<int32_t> GetStep(int32_t source) const
+    {
+        optional<int32_t> step;
+        for (int32_t offset : neighborOffsets) {
+            const int32_t n = source + offset;
+            if (distances[n] == Unreachable) {
+                continue;
+            }
+            if (!step ||
+                std::tie(distances[n], labels[n]) <
+                    std::tie(distances[*step], labels[*step])) {
+                step = n;
+            }
+        }
+        return step;
+    }
+
+private:
+    // Generations start at 1, so 0 matches no state.
+    uint64_t builtAt = 0;
+    uint64_t askedAt = 0;
+    array<int32_t, 4> neighborOffsets = {};
+    vector<Distance> distances;
+    vector<int32_t> labels;
+    vector<int32_t> queue;
+};
 
-set<Coordinates> GetAllOpenSquares(const Map & map, const State & state)
+// Breadth-first search over open, unoccupied squares.
+//
+// Along with distances, this tracks the first step of the shortest path to
+// each square, taking the first step in "reading order" when several shortest
+// paths exist.  Squares are expanded one distance at a time, so every shortest
+// path into a square has been seen before that square is expanded.  The cell
+// index increases in reading order, so comparing indexes is enough to break
+// ties.
+//
+// Squares are indexed by the map's Grid.  All buffers are allocated when the
+// engine first sees a map of a given size and are reused by every search.
+// Rather than clearing them, each search stamps the cells it reaches, so a
+// search that stops early costs only as much as the area it covered.
+class BfsEngine
 {
-    set<Coordinates> out;
-    for (Row y = 0; y < MapSize; y++) {
-        for (Column x = 0; x < MapSize; x++) {
-            Coordinates coords = {x, y};
-            if (map[y][x] && !Contains(state.entitiesByLocation, coords)) {
-                out.insert(coords);
+public:
+    static constexpr int32_t NoCell = -1;
+
+    // Finds the distance to every square reachable from the source.
+    void Run(const Map & map, const State & state, Coordinates source)
+    {
+        Search(map, state, source, [](int32_t) { return false; });
+    }
+
+    // Searches outward from the source only until it finds the nearest
+    // squares next to an entity of the target type, returning the first of
+    // them in "reading order", or {} if none can be reached.
+    optional<Coordinates> FindNearestInRange(const Map & map,
+                                             const State & state,
+                                             Coordinates source,
+                                             EntityType targetType)
+    {
+        const int32_t found = Search(map, state, source, [&](int32_t index) {
+            return state.IsInRangeOf(targetType, index);
+        });
+        if (found == NoCell) {
+            return {};
+        }
+        return grid.CoordinatesOf(found);
+    }
+
+    Distance GetDistance(Coordinates coords) const
+    {
+        const int32_t index = grid.IndexOf(coords);
+        return Reached(index) ? distances[index] : Unreachable;
+    }
+
+    optional<Coordinates> GetPredecessor(Coordinates coords) const
+    {
+        const int32_t index = grid.IndexOf(coords);
+        if (!Reached(index) || predecessors[index] == NoCell) {
+            return {};
+        }
+        return grid.CoordinatesOf(predecessors[index]);
+    }
+
+    // Returns the adjacent square to step onto to reach the given square.
+    Coordinates GetFirstStep(Coordinates dest) const
+    {
+        return grid.CoordinatesOf(firstSteps[grid.IndexOf(dest)]);
+    }
+
+    // The distance field towards entities of the given type, which the
+    // engine keeps so that it can be shared by the entities hunting them.
+    DistanceField & GetDistanceField(EntityType targetType)
+    {
+        return distanceFields[static_cast<int>(targetType)];
+    }
+
+    // Returns the path from the source to the given square, excluding the
+    // source, through the reading-order-first first step.
+    Path GetPath(Coordinates dest) const
+    {
+        Path out;
+        for (int32_t i = grid.IndexOf(dest); predecessors[i] != NoCell;
+             i = predecessors[i]) {
+            out.push_back(grid.CoordinatesOf(i));
+        }
+        std::reverse(out.begin(), out.end());
+        return out;
+    }
+
+private:
+    bool Reached(int32_t index) const { return stamps[index] == stamp; }
+
+    // Runs the search, stopping once every square at the distance of the
+    // nearest goal has been found.  Returns the first goal in "reading order",
+    // or NoCell.
+    template <typename IsGoal>
+    int32_t Search(const Map & map, const State & state, Coordinates source,
+                   IsGoal isGoal)
+    {
+        if (grid != map.GetGrid()) {
+            Resize(map.GetGrid());
+        }
+        if (++stamp == 0) {
+            // The stamp wrapped, so old stamps could look current.
+            std::fill(stamps.begin(), stamps.end(), 0);
+            stamp = 1;
+        }
+
+        const auto & cells = map.GetCells();
+        const auto & entityAt = state.entityAt;
+        const auto neighborOffsets = grid.NeighborOffsets();
+
+        int32_t found = NoCell;
+        Distance foundDistance = Unreachable;
+
+        int32_t head = 0;
+        int32_t tail = 0;
+        const int32_t s = grid.IndexOf(source);
+        stamps[s] = stamp;
+        distances[s] = 0;
+        predecessors[s] = NoCell;
+        firstSteps[s] = NoCell;
+        queue[tail++] = s;
+        while (head != tail) {
+            const int32_t u = queue[head++];
+            if (distances[u] >= foundDistance) {
+                // Everything at the goal's distance has been found.
+                break;
+            }
+            const int32_t firstStep = firstSteps[u];
+            for (int32_t offset : neighborOffsets) {
+                const int32_t v = u + offset;
+                if (!cells[v] || entityAt[v] != NoEntity) {
+                    continue;
+                }
+                const int32_t step = firstStep == NoCell ? v : firstStep;
+                if (!Reached(v)) {
+                    stamps[v] = stamp;
+                    distances[v] = distances[u] + 1;
+                    predecessors[v] = u;
+                    firstSteps[v] = step;
+                    queue[tail++] = v;
+                    if (isGoal(v) && (found == NoCell || v < found)) {
+                        found = v;
+                        foundDistance = distances[v];
+                    }
+                } else if (distances[v] == distances[u] + 1 &&
+                           step < firstSteps[v]) {
+                    predecessors[v] = u;
+                    firstSteps[v] = step;
+                }
             }
         }
+        return found;
+    }
+
+    void Resize(const Grid & newGrid)
+    {
+        grid = newGrid;
+        stamps.assign(grid.CellCount(), 0);
+        stamp = 0;
+        distances.resize(grid.CellCount());
+        predecessors.resize(grid.CellCount());
+        firstSteps.resize(grid.CellCount());
+        queue.resize(grid.CellCount());
+    }
+
+    Grid grid;
+    vector<uint32_t> stamps;
+    uint32_t stamp = 0;
+    vector<Distance> distances;
+    vector<int32_t> predecessors;
+    vector<int32_t> firstSteps;
+    vector<int32_t> queue;
+    array<DistanceField, 2> distanceFields;
+};
+
+// Returns the adjacent square we should move onto to reach the nearest target,
+// or {} if there are no paths to targets.
+//
+// Where several entities search in a row without anything moving or dying in
+// between, e.g. because they are stuck behind their own lines, the step is
+// read from the engine's distance field for the target type, which is built
+// once and shared.  Otherwise one search finds both the nearest square in
+// range of a target and the first step towards it, and stops as soon as that
+// square is known.
+optional<Coordinates> SearchForStep(BfsEngine & bfs, const Map & map,
+                                    const State & state,
+                                    const Coordinates entity,
+                                    EntityType targetType)
+{
+    DistanceField & field = bfs.GetDistanceField(targetType);
+    if (!field.IsCurrent(state) && field.IsWorthBuilding(state)) {
+        field.Build(map, state, targetType);
+    }
+    if (field.IsCurrent(state)) {
+        const auto step = field.GetStep(state.grid.IndexOf(entity));
+        if (!step) {
+            return {};
+        }
+        return state.grid.CoordinatesOf(*step);
+    }
+
+    const auto nearestDest =
+        bfs.FindNearestInRange(map, state, entity, targetType);
+    if (!nearestDest) {
+        return {};
+    }
+    return bfs.GetFirstStep(*nearestDest);
+}
+
+// Returns either the path we should follow to reach the nearest target, whose
+// first step is the adjacent square we should move onto, or {} if there are no
+// paths to targets.
+optional<Path> SearchForTarget(BfsEngine & bfs, const Map & map,
+                               const State & state, const Coordinates entity,
+                               EntityType targetType)
+{
+    const auto nearestDest =
+        bfs.FindNearestInRange(map, state, entity, targetType);
+    if (!nearestDest) {
+        return {};
+    }
+    return bfs.GetPath(*nearestDest);
+}
+
+optional<Path> SearchForTarget(const Map & map, const State & state,
+                               const Coordinates entity, EntityType targetType)
+{
+    BfsEngine bfs;
+    return SearchForTarget(bfs, map, state, entity, targetType);
+}
+
+int CountEntityHitPoints(const State & state, EntityType type)
+{
+    int out = 0;
+    for (EntityId id = 1; id < state.EntityIdEnd(); id++) {
+        if (state.types[id] == type) {
+            out += state.hitPoints[id];
+        }
     }
     return out;
 }
 
-struct BfsResult
+void SetAttackPower(State & state, EntityType type, AttackPower attackPower)
+{
+    for (EntityId id = 1; id < state.EntityIdEnd(); id++) {
+        if (state.types[id] == type) {
+            state.attackPowers[id] = attackPower;
+        }
+    }
+}
+
+struct BattleRules
 {
-    std::map<Coordinates, Distance> distances;
-    std::map<Coordinates, optional<Coordinates>> predecessors;
+    // Stop the battle as soon as any elf dies.
+    bool abandonOnElfDeath = false;
 };
 
-BfsResult Bfs(const Map & map, const State & state, Coordinates s)
+enum class RoundResult
 {
-    enum class Color
+    // Every unit took its turn.
+    Completed,
+    // A unit found no targets at the start of its turn.
+    CombatEnded,
+    // An elf died and the rules say to give up.
+    Abandoned,
+};
+
+// Receives notifications as a battle progresses, e.g. to draw it.
+struct NullBattleObserver
+{
+    // The entity is about to move.
+    void BeforeMove(const State & /*state*/, EntityId /*id*/) {}
+    // The attacker has just hit the target, which may now be dead.
+    void AfterAttack(const State & /*state*/, EntityId /*attacker*/,
+                     EntityId /*target*/)
     {
-        White,
-        Gray,
-        Black,
-    };
+    }
+    // The entity's turn is over.
+    void AfterAction(const State & /*state*/, EntityId /*id*/) {}
+    void AfterRound(const State & /*state*/) {}
+};
 
-    set<Coordinates> vertexesExcludingSource = GetAllOpenSquares(map, state);
-    set<Coordinates> vertexes = vertexesExcludingSource;
-    vertexes.insert(s);
-    std::map<Coordinates, Color> color;
-    std::map<Coordinates, Distance> d;
-    std::map<Coordinates, optional<Coordinates>> pi; // Predecessor
-    deque<Coordinates> q;
-
-    for (Coordinates u : vertexesExcludingSource) {
-        d[u] = std::numeric_limits<Distance>::max();
-        pi[u] = {};
-    }
-    color[s] = Color::Gray;
-    d[s] = 0;
-    pi[s] = {};
-    q.push_back(s);
-    while (!q.empty()) {
-        Coordinates u = q.front();
-        q.pop_front();
-        for (Coordinates v : GetAdjacentOpenSquares(map, state, u)) {
-            if (color[v] == Color::White) {
-                color[v] = Color::Gray;
-                d[v] = d[u] + 1;
-                pi[v] = u;
-                q.push_back(v);
-            }
+// Runs one round.  Turn order comes from sorting the living entities into
+// "reading order"; once the state's buffers have grown to fit, a round
+// allocates nothing.
+template <typename Observer>
+RoundResult TakeTurns(const Map & map, State & state, BfsEngine & bfs,
+                      const BattleRules & rules, Observer & observer)
+{
+    auto & turnOrder = state.turnOrder;
+    turnOrder.clear();
+    for (EntityId id = 1; id < state.EntityIdEnd(); id++) {
+        if (state.IsAlive(id)) {
+            turnOrder.push_back(id);
         }
-        color[u] = Color::Black;
     }
+    std::sort(turnOrder.begin(), turnOrder.end(),
+              [&](EntityId a, EntityId b) {
+                  return state.coords[a] < state.coords[b];
+              });
+
+    for (auto id : turnOrder) {
+        if (!state.IsAlive(id)) {
+            continue;
+        }
+
+        const EntityType targetType = EnemyType(state.types[id]);
+        if (state.CountLiving(targetType) == 0) {
+            return RoundResult::CombatEnded;
+        }
+
+        auto attackThisTarget =
+            SelectAdjacentTarget(state, state.coords[id], targetType);
 
-    BfsResult result;
-    result.distances = std::move(d);
-    result.predecessors = std::move(pi);
-    return result;
+        if (!attackThisTarget) {
+            // Search for the nearest target.
+            const auto move =
+                SearchForStep(bfs, map, state, state.coords[id], targetType);
+            if (move) {
+                observer.BeforeMove(state, id);
+                state.Move(id, *move);
+                attackThisTarget =
+                    SelectAdjacentTarget(state, state.coords[id], targetType);
+            }
+        }
+
+        bool elfDied = false;
+        if (attackThisTarget) {
+            const EntityId target = *attackThisTarget;
+            const bool died = state.Damage(target, state.attackPowers[id]);
+            elfDied = died && state.types[target] == EntityType::Elf;
+            observer.AfterAttack(state, id, target);
+        }
+
+        observer.AfterAction(state, id);
+
+        if (elfDied && rules.abandonOnElfDeath) {
+            return RoundResult::Abandoned;
+        }
+    }
+    state.round++;
+    return RoundResult::Completed;
 }
 
-set<Coordinates> FindSquaresInRangeOfTargets(const Map & map,
-                                             const State & state,
-                                             const set<Coordinates> & targets)
+struct BattleOutcome
+{
+    // True if the battle was stopped early by the rules, in which case there
+    // is no winner.
+    bool abandoned = false;
+    EntityType winner = EntityType::Elf;
+    Round fullRounds = 0;
+    HitPoints remainingHp = 0;
+    uint32_t elvesLost = 0;
+
+    int64_t Score() const { return int64_t{fullRounds} * remainingHp; }
+};
+
+template <typename Observer>
+BattleOutcome RunBattle(const Map & map, State & state, BfsEngine & bfs,
+                        const BattleRules & rules, Observer & observer)
 {
-    set<Coordinates> out;
-    for (Coordinates target : targets) {
-        for (auto neighbor : GetAdjacentOpenSquares(map, state, target)) {
-            out.insert(neighbor);
+    RoundResult result;
+    while ((result = TakeTurns(map, state, bfs, rules, observer)) ==
+           RoundResult::Completed) {
+        observer.AfterRound(state);
+    }
+    observer.AfterRound(state);
+
+    BattleOutcome outcome;
+    outcome.abandoned = result == RoundResult::Abandoned;
+    outcome.fullRounds = state.round - 1;
+    const int elfHp = CountEntityHitPoints(state, EntityType::Elf);
+    const int goblinHp = CountEntityHitPoints(state, EntityType::Goblin);
+    outcome.winner = elfHp > 0 ? EntityType::Elf : EntityType::Goblin;
+    outcome.remainingHp = elfHp + goblinHp;
+    for (EntityId id = 1; id < state.EntityIdEnd(); id++) {
+        if (state.types[id] == EntityType::Elf && !state.IsAlive(id)) {
+            outcome.elvesLost++;
         }
     }
-    return out;
+    return outcome;
 }
 
+BattleOutcome RunBattle(const Map & map, State state,
+                        const BattleRules & rules = {})
+{
+    BfsEngine bfs;
+    NullBattleObserver observer;
+    return RunBattle(map, state, bfs, rules, observer);
+}
 
-// Returns either the adjacent square we should move onto to reach the
-// nearest target, or {} if there are no paths to targets.
-optional<Path> SearchForTarget(const Map & map, const State & state,
-                               const Coordinates entity,
-                               const set<Coordinates> & targets)
+enum class BattleEventType : uint8_t
 {
-    const BfsResult bfsToSource = Bfs(map, state, entity);
+    // The entity stepped onto the cell with index `arg`.
+    Move,
+    // The entity attacked the entity `arg`.
+    Attack,
+    // The entity died.
+    Death,
+    // The round ended; `arg` is the round to be played next.
+    EndOfRound,
+};
 
-    // Set will automatically be ordered in "reading order", so the first of
-    // each distance we find will be the priority.
-    const set<Coordinates> squaresInRangeOfTargets =
-        FindSquaresInRangeOfTargets(map, state, targets);
-    if (squaresInRangeOfTargets.empty()) {
-        return {};
+struct BattleEvent
+{
+    BattleEventType type;
+    EntityId entity;
+    uint32_t arg;
+
+    bool operator==(const BattleEvent & other) const
+    {
+        return std::tie(type, entity, arg) ==
+               std::tie(other.type, other.entity, other.arg);
     }
-    Coordinates nearestDest = *squaresInRangeOfTargets.begin();
-    Distance shortestDistance = bfsToSource.distances.at(nearestDest);
-    for (Coordinates dest : squaresInRangeOfTargets) {
-        Distance distance = bfsToSource.distances.at(dest);
-        if (distance < shortestDistance) {
-            shortestDistance = distance;
-            nearestDest = dest;
+};
+
+// The state at the start of a round, along with the index of the first event
+// logged in that round.
+struct BattleSnapshot
+{
+    State state;
+    std::size_t firstEvent;
+};
+
+// Applies logged events to the state, starting from the given event, until
+// the state reaches the start of the given round or the log runs out.
+// Returns the index of the first event not applied.
+std::size_t ReplayEvents(State & state, const vector<BattleEvent> & events,
+                         std::size_t firstEvent, Round untilRound)
+{
+    std::size_t i = firstEvent;
+    while (i < events.size() && state.round < untilRound) {
+        const BattleEvent & event = events[i++];
+        switch (event.type) {
+        case BattleEventType::Move:
+            state.Move(event.entity, state.grid.CoordinatesOf(event.arg));
+            break;
+        case BattleEventType::Attack:
+            state.Damage(event.arg, state.attackPowers[event.entity]);
+            break;
+        case BattleEventType::Death:
+            // Already applied by the attack.
+            break;
+        case BattleEventType::EndOfRound:
+            state.round = event.arg;
+            break;
         }
     }
+    return i;
+}
 
-    // If there was no path, shortestDistance will be "infinity".
-    // XXX This is a horrible paradigm. Do something else.
+// A battle observer that logs every move, attack and death, and snapshots the
+// state at the start of every `snapshotInterval`th round, so that the state at
+// the start of any round can be rebuilt by replaying events from the nearest
+// snapshot instead of simulating the battle again.
+class BattleRecorder
+{
+public:
+    explicit BattleRecorder(const State & initialState,
+                            Round snapshotInterval = 100)
+        : snapshotInterval(std::max(snapshotInterval, Round{1}))
+    {
+        snapshots.push_back({initialState, 0});
+    }
 
-    if (shortestDistance == std::numeric_limits<Distance>::max()) {
-        return {};
+    void BeforeMove(const State & /*state*/, EntityId id) { mover = id; }
+    void AfterAttack(const State & state, EntityId attacker, EntityId target)
+    {
+        LogMove(state);
+        events.push_back({BattleEventType::Attack, attacker, target});
+        if (!state.IsAlive(target)) {
+            events.push_back({BattleEventType::Death, target, 0});
+        }
+    }
+    void AfterAction(const State & state, EntityId /*id*/) { LogMove(state); }
+    void AfterRound(const State & state)
+    {
+        events.push_back({BattleEventType::EndOfRound, NoEntity, state.round});
+        if (state.round % snapshotInterval == 0 &&
+            state.round > snapshots.back().state.round) {
+            snapshots.push_back({state, events.size()});
+        }
     }
 
+    const vector<BattleEvent> & GetEvents() const { return events; }
 
-    BfsResult bfsToTarget = Bfs(map, state, nearestDest);
+    // Returns the state at the start of the given round, or {} if the battle
+    // ended before it.
+    optional<State> RestoreRound(Round round) const
+    {
+        auto snapshot = std::upper_bound(
+            snapshots.begin(), snapshots.end(), round,
+            [](Round r, const BattleSnapshot & snap) {
+                return r < snap.state.round;
+            });
+        if (snapshot == snapshots.begin()) {
+            return {};
+        }
+        --snapshot;
+        State state = snapshot->state;
+        ReplayEvents(state, events, snapshot->firstEvent, round);
+        if (state.round != round) {
+            return {};
+        }
+        return state;
+    }
 
-    // Our current location wasn't part of the BFS, so pick our best neighbor.
-    auto openNeighbors = GetAdjacentOpenSquares(map, state, entity);
-    Coordinates bestNeighbor = *openNeighbors.begin();
-    Distance bestNeighborDistance = bfsToTarget.distances.at(bestNeighbor);
-    for (auto neighbor : openNeighbors) {
-        auto distance = bfsToTarget.distances.at(neighbor);
-        if (distance < bestNeighborDistance) {
-            bestNeighborDistance = distance;
-            bestNeighbor = neighbor;
+private:
+    void LogMove(const State & state)
+    {
+        if (mover != NoEntity) {
+            const auto to = state.grid.IndexOf(state.coords[mover]);
+            events.push_back({BattleEventType::Move, mover,
+                              static_cast<uint32_t>(to)});
+            mover = NoEntity;
         }
     }
 
-    Path out;
-    Coordinates next = bestNeighbor;
-    out.push_back(next);
-    while (next != nearestDest) {
-        next = *bfsToTarget.predecessors.at(next);
-        out.push_back(next);
+    Round snapshotInterval;
+    EntityId mover = NoEntity;
+    vector<BattleEvent> events;
+    vector<BattleSnapshot> snapshots;
+};
+
+// Event logs are stored as 9-byte records: the event type followed by the
+// entity and the argument as little-endian 32-bit numbers.
+void WriteEvents(std::ostream & stream, const vector<BattleEvent> & events)
+{
+    for (const auto & event : events) {
+        array<char, 9> record;
+        record[0] = static_cast<char>(event.type);
+        for (int i = 0; i < 4; i++) {
+            record[1 + i] = static_cast<char>(event.entity >> (8 * i));
+            record[5 + i] = static_cast<char>(event.arg >> (8 * i));
+        }
+        stream.write(record.data(), record.size());
     }
+}
 
-    return out;
+vector<BattleEvent> ReadEvents(std::istream & stream)
+{
+    vector<BattleEvent> events;
+    array<char, 9> record;
+    while (stream.read(record.data(), record.size())) {
+        BattleEvent event{static_cast<BattleEventType>(record[0]), 0, 0};
+        for (int i = 0; i < 4; i++) {
+            event.entity |= uint32_t{static_cast<uint8_t>(record[1 + i])}
+                            << (8 * i);
+            event.arg |= uint32_t{static_cast<uint8_t>(record[5 + i])}
+                         << (8 * i);
+        }
+        events.push_back(event);
+    }
+    return events;
 }
 
-set<Coordinates> GetTargets(const State & state, EntityType targetType)
+struct ElfAttackPowerResult
+{
+    AttackPower attackPower;
+    BattleOutcome outcome;
+};
+
+// Finds the lowest elf attack power with which the elves win without losing
+// anyone, if there is one.  Above StartingHitPoints every hit kills, so no
+// higher powers are tried.
+//
+// Candidate powers are handed out in increasing order from a shared counter to
+// a pool of threads, each simulating its own copy of the battle and giving up
+// as soon as an elf dies.  Once some power has won, no higher powers are
+// started, but lower ones still running are allowed to finish, so the answer
+// is the lowest winning power even if winning isn't monotonic in power.
+optional<ElfAttackPowerResult>
+FindElfAttackPower(const Map & map, const State & initialState,
+                   unsigned threadCount = std::thread::hardware_concurrency())
 {
-    set<Coordinates> out;
-    for (auto & [id, entity] : state.entities) {
-        if (entity.type == targetType && entity.hp > 0) {
-            out.insert(entity.coords);
+    const AttackPower firstCandidate = 4;
+    std::atomic<AttackPower> nextCandidate = firstCandidate;
+    std::atomic<AttackPower> bestPower =
+        std::numeric_limits<AttackPower>::max();
+    std::mutex resultMutex;
+    optional<ElfAttackPowerResult> best;
+
+    BattleRules rules;
+    rules.abandonOnElfDeath = true;
+
+    const auto worker = [&]() {
+        BfsEngine bfs;
+        NullBattleObserver observer;
+        while (true) {
+            const AttackPower power = nextCandidate++;
+            if (power > bestPower ||
+                power > static_cast<AttackPower>(StartingHitPoints)) {
+                return;
+            }
+            State state = initialState;
+            SetAttackPower(state, EntityType::Elf, power);
+            const BattleOutcome outcome =
+                RunBattle(map, state, bfs, rules, observer);
+            if (outcome.abandoned || outcome.winner != EntityType::Elf) {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(resultMutex);
+            if (!best || power < best->attackPower) {
+                best = ElfAttackPowerResult{power, outcome};
+                bestPower = power;
+            }
         }
+    };
+
+    vector<std::thread> threads;
+    for (unsigned i = 0; i < std::max(threadCount, 1U); i++) {
+        threads.emplace_back(worker);
     }
-    return out;
+    for (auto & thread : threads) {
+        thread.join();
+    }
+
+    return best;
 }
 
 } // namespace day15
@@ -9,54 +9,72 @@ TEST(SelectAdjacentTargetTest, AllEqualHp)
 {
     State state = surroundedState;
     EntityId two = 2;
-    ASSERT_EQ(
-        two, *SelectAdjacentTarget(state, surroundedSource, surroundedTargets));
+    ASSERT_EQ(two, *SelectAdjacentTarget(state, surroundedSource,
+                                         EntityType::Goblin));
 }
 
 TEST(SelectAdjacentTargetTest, NorthLowestHp)
 {
     State state = surroundedState;
-    state.entities.at(2).hp--;
+    state.hitPoints[2]--;
     EntityId two = 2;
-    ASSERT_EQ(
-        two, *SelectAdjacentTarget(state, surroundedSource, surroundedTargets));
+    ASSERT_EQ(two, *SelectAdjacentTarget(state, surroundedSource,
+                                         EntityType::Goblin));
 }
 
 TEST(SelectAdjacentTargetTest, WestLowestHp)
 {
     State state = surroundedState;
-    state.entities.at(3).hp--;
+    state.hitPoints[3]--;
     EntityId three = 3;
     ASSERT_EQ(three, *SelectAdjacentTarget(state, surroundedSource,
-                                           surroundedTargets));
+                                           EntityType::Goblin));
 }
 
 TEST(SelectAdjacentTargetTest, EastLowestHp)
 {
     State state = surroundedState;
-    state.entities.at(4).hp--;
+    state.hitPoints[4]--;
     EntityId four = 4;
     ASSERT_EQ(four, *SelectAdjacentTarget(state, surroundedSource,
-                                          surroundedTargets));
+                                          EntityType::Goblin));
 }
 
 TEST(SelectAdjacentTargetTest, SouthLowestHp)
 {
     State state = surroundedState;
-    state.entities.at(5).hp--;
+    state.hitPoints[5]--;
     EntityId five = 5;
     ASSERT_EQ(five, *SelectAdjacentTarget(state, surroundedSource,
-                                          surroundedTargets));
+                                          EntityType::Goblin));
 }
 
 TEST(SelectAdjacentTargetTest, EastWestTie)
 {
     State state = surroundedState;
-    state.entities.at(3).hp--;
+    state.hitPoints[3]--;
     EntityId three = 3;
-    state.entities.at(4).hp--;
+    state.hitPoints[4]--;
     ASSERT_EQ(three, *SelectAdjacentTarget(state, surroundedSource,
-                                           surroundedTargets));
+                                           EntityType::Goblin));
+}
+
+TEST(StateTest, InRangeFollowsMovesAndDeaths)
+{
+    State state = surroundedState;
+    const Grid & grid = state.grid;
+    ASSERT_TRUE(state.IsInRangeOf(EntityType::Goblin, grid.IndexOf({2, 2})));
+    ASSERT_TRUE(state.IsInRangeOf(EntityType::Goblin, grid.IndexOf({1, 1})));
+
+    // Only the north goblin (2) is next to (2,0).
+    ASSERT_TRUE(state.IsInRangeOf(EntityType::Goblin, grid.IndexOf({2, 0})));
+    state.Move(2, {1, 1});
+    ASSERT_FALSE(state.IsInRangeOf(EntityType::Goblin, grid.IndexOf({2, 0})));
+    ASSERT_TRUE(state.IsInRangeOf(EntityType::Goblin, grid.IndexOf({1, 0})));
+
+    ASSERT_TRUE(state.Damage(2, StartingHitPoints));
+    ASSERT_FALSE(state.IsInRangeOf(EntityType::Goblin, grid.IndexOf({1, 0})));
+    ASSERT_FALSE(state.IsInRangeOf(EntityType::Elf, grid.IndexOf({1, 0})));
 }
 
 TEST(SearchForTargetTest, RedditExample1)
@@ -76,10 +94,8 @@ TEST(SearchForTargetTest, RedditExample1)
         return ReadInput(ss);
     }();
 
-    const set<Coordinates> targets = GetTargets(state, EntityType::Goblin);
-
     const Coordinates elf = {2,1};
-    const auto maybePath = SearchForTarget(map, state, elf, targets);
+    const auto maybePath = SearchForTarget(map, state, elf, EntityType::Goblin);
 
     const Path expectedPath = {{3,1}, {4,1}, {5,1}, {5,2}};
     
@@ -102,16 +118,166 @@ TEST(SearchForTargetTest, RedditExample2)
         return ReadInput(ss);
     }();
 
-    const set<Coordinates> targets = GetTargets(state, EntityType::Elf);
-
     const Coordinates goblin = {2,1};
-    const auto maybePath = SearchForTarget(map, state, goblin, targets);
+    const auto maybePath = SearchForTarget(map, state, goblin, EntityType::Elf);
 
     const Path expectedPath = {{2,2}, {2,3}, {1,3}};
     
     ASSERT_EQ(*maybePath, expectedPath);
 }
 
+TEST(DistanceFieldTest, MatchesSearchForTarget)
+{
+    const auto & [map, initialState] = puzzleInput;
+    State state = initialState;
+    BfsEngine bfs;
+    NullBattleObserver observer;
+    array<DistanceField, 2> fields;
+    do {
+        for (auto type : {EntityType::Elf, EntityType::Goblin}) {
+            fields[static_cast<int>(type)].Build(map, state, type);
+        }
+        for (EntityId id = 1; id < state.EntityIdEnd(); id++) {
+            if (!state.IsAlive(id)) {
+                continue;
+            }
+            const EntityType targetType = EnemyType(state.types[id]);
+            const auto path =
+                SearchForTarget(map, state, state.coords[id], targetType);
+            const auto step = fields[static_cast<int>(targetType)].GetStep(
+                state.grid.IndexOf(state.coords[id]));
+            if (!path || path->empty()) {
+                ASSERT_FALSE(step);
+            } else {
+                ASSERT_TRUE(step);
+                ASSERT_EQ(state.grid.CoordinatesOf(*step), path->front());
+            }
+        }
+    } while (TakeTurns(map, state, bfs, {}, observer) ==
+             RoundResult::Completed);
+}
+
+TEST(SearchForStepTest, SharesDistanceFieldUntilSomethingMoves)
+{
+    const auto & [map, initialState] = puzzleInput;
+    State state = initialState;
+    BfsEngine bfs;
+    const DistanceField & field = bfs.GetDistanceField(EntityType::Elf);
+
+    // Every goblin steps as if it had searched on its own.
+    const auto checkGoblins = [&]() {
+        for (EntityId id = 1; id < state.EntityIdEnd(); id++) {
+            if (!state.IsAlive(id) || state.types[id] != EntityType::Goblin) {
+                continue;
+            }
+            const auto path = SearchForTarget(map, state, state.coords[id],
+                                              EntityType::Elf);
+            const auto step = SearchForStep(bfs, map, state, state.coords[id],
+                                            EntityType::Elf);
+            if (!path || path->empty()) {
+                ASSERT_FALSE(step);
+            } else {
+                ASSERT_TRUE(step);
+                ASSERT_EQ(*step, path->front());
+            }
+        }
+    };
+
+    // The first goblin searches alone, and the second builds the field.
+    ASSERT_FALSE(field.IsCurrent(state));
+    checkGoblins();
+    ASSERT_TRUE(field.IsCurrent(state));
+
+    // A copy of the state is a different state.
+    const State copy = state;
+    ASSERT_FALSE(field.IsCurrent(copy));
+
+    // Moving makes the field stale until two goblins have searched again.
+    const EntityId goblin = state.GetEntityAt({2, 6});
+    ASSERT_EQ(state.types[goblin], EntityType::Goblin);
+    state.Move(goblin, {3, 6});
+    ASSERT_FALSE(field.IsCurrent(state));
+    checkGoblins();
+    ASSERT_TRUE(field.IsCurrent(state));
+}
+
+TEST(RunBattleTest, Example)
+{
+    const auto & [map, state] = exampleInput;
+    const BattleOutcome outcome = RunBattle(map, state);
+
+    ASSERT_FALSE(outcome.abandoned);
+    ASSERT_EQ(outcome.winner, EntityType::Goblin);
+    ASSERT_EQ(outcome.fullRounds, 47u);
+    ASSERT_EQ(outcome.remainingHp, 590);
+    ASSERT_EQ(outcome.Score(), 27730);
+}
+
+TEST(RunBattleTest, AbandonOnElfDeath)
+{
+    const auto & [map, state] = exampleInput;
+    BattleRules rules;
+    rules.abandonOnElfDeath = true;
+    const BattleOutcome outcome = RunBattle(map, state, rules);
+
+    ASSERT_TRUE(outcome.abandoned);
+    ASSERT_EQ(outcome.elvesLost, 1u);
+}
+
+TEST(BattleRecorderTest, RestoreRound)
+{
+    const auto & [map, initialState] = exampleInput;
+    State state = initialState;
+    BfsEngine bfs;
+    BattleRecorder recorder(initialState, 10);
+    RunBattle(map, state, bfs, {}, recorder);
+
+    State expected = initialState;
+    NullBattleObserver observer;
+    while (expected.round < 25) {
+        TakeTurns(map, expected, bfs, {}, observer);
+    }
+    const auto restored = recorder.RestoreRound(25);
+    ASSERT_TRUE(restored);
+    ASSERT_EQ(restored->round, 25u);
+    ASSERT_EQ(restored->coords, expected.coords);
+    ASSERT_EQ(restored->hitPoints, expected.hitPoints);
+    ASSERT_EQ(restored->entityAt, expected.entityAt);
+    ASSERT_EQ(restored->inRangeOf, expected.inRangeOf);
+
+    // Resuming from the restored round finishes the battle the same way.
+    const BattleOutcome outcome = RunBattle(map, *restored);
+    ASSERT_EQ(outcome.Score(), 27730);
+
+    ASSERT_FALSE(recorder.RestoreRound(49));
+}
+
+TEST(BattleRecorderTest, WriteAndReadEvents)
+{
+    const auto & [map, initialState] = exampleInput;
+    State state = initialState;
+    BfsEngine bfs;
+    BattleRecorder recorder(initialState);
+    RunBattle(map, state, bfs, {}, recorder);
+
+    std::stringstream ss;
+    WriteEvents(ss, recorder.GetEvents());
+    ASSERT_EQ(ss.str().size(), recorder.GetEvents().size() * 9);
+    ASSERT_EQ(ReadEvents(ss), recorder.GetEvents());
+}
+
+TEST(FindElfAttackPowerTest, Example)
+{
+    const auto & [map, state] = exampleInput;
+    const auto result = FindElfAttackPower(map, state, 4);
+
+    ASSERT_TRUE(result);
+    ASSERT_EQ(result->attackPower, 15u);
+    ASSERT_EQ(result->outcome.winner, EntityType::Elf);
+    ASSERT_EQ(result->outcome.elvesLost, 0u);
+    ASSERT_EQ(result->outcome.Score(), 4988);
+}
+
 int main(int argc, char ** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -62,41 +62,17 @@ const pair<Map, State> puzzleInput = []() {
     return ReadInput(ss);
 }();
 
+// An elf with goblins on all four sides.
 const State surroundedState = []() {
-    State state;
-
-    state.entities.insert({1, {1, EntityType::Elf, {2, 2}}});
-    state.entitiesByLocation.insert({{2, 2}, 1});
-    state.entities.at(1).hp = 200;
-
-    state.entities.insert({2, {2, EntityType::Goblin, {2, 1}}});
-    state.entitiesByLocation.insert({{2, 1}, 2});
-    state.entities.at(2).hp = 200;
-
-    state.entities.insert({3, {3, EntityType::Goblin, {1, 2}}});
-    state.entitiesByLocation.insert({{1, 2}, 3});
-    state.entities.at(3).hp = 200;
-
-    state.entities.insert({4, {4, EntityType::Goblin, {3, 2}}});
-    state.entitiesByLocation.insert({{3, 2}, 4});
-    state.entities.at(4).hp = 200;
-
-    state.entities.insert({5, {5, EntityType::Goblin, {2, 3}}});
-    state.entitiesByLocation.insert({{2, 3}, 5});
-    state.entities.at(5).hp = 200;
-
+    State state(Grid{5, 5});
+    state.AddEntity(EntityType::Elf, {2, 2});
+    state.AddEntity(EntityType::Goblin, {2, 1});
+    state.AddEntity(EntityType::Goblin, {1, 2});
+    state.AddEntity(EntityType::Goblin, {3, 2});
+    state.AddEntity(EntityType::Goblin, {2, 3});
     return state;
 }();
 
 const Coordinates surroundedSource = {2, 2};
 
-const set<Coordinates> surroundedTargets = []() {
-    set<Coordinates> targets;
-    targets.insert({2, 1});
-    targets.insert({1, 2});
-    targets.insert({3, 2});
-    targets.insert({2, 3});
-    return targets;
-}();
-
 #endif // AOC_DAY15TEST_HPP
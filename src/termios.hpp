@@ -4,6 +4,7 @@
 #define AOC_TERMIOS_HPP
 
 #include <errno.h>
+#include <sys/ioctl.h>
 #include <termios.h>
 
 #include <system_error>
@@ -27,6 +28,16 @@ void tcsetattr(int fileDescriptor, const termios & in, int optional_actions)
     }
 }
 
+/// Returns the size of the terminal open on the given file descriptor.
+winsize get_window_size(int fileDescriptor)
+{
+    winsize out;
+    if (ioctl(fileDescriptor, TIOCGWINSZ, &out) == -1) {
+        throw std::system_error(errno, std::generic_category());
+    }
+    return out;
+}
+
 /// RAII wrapper for a modified termios state.
 /// It is a common pattern to read termios with tcgetattr(), stash the original
 /// away, modify it, and then restore the original later.  This class is an RAII